@@ -0,0 +1,158 @@
+#ifndef INCLUDED_JACOBI_LEIBNIZ_TEMPLATES_H_
+#define INCLUDED_JACOBI_LEIBNIZ_TEMPLATES_H_
+
+#include "kontsevich_graph.hpp"
+#include "leibniz_graph.hpp"
+#include "kontsevich_graph_sum.hpp"
+#include "util/cartesian_product.hpp"
+#include <vector>
+#include <set>
+#include <functional>
+#include <algorithm>
+
+// Templates for differential consequences of the Jacobi identity, with `internal` vertices of which the last 2*k form k Jacobiators.
+// Let L = internal + external - 2*k. Jacobiator i consists of the vertices L + 2*i (with targets a_i < b_i) and L + 2*i + 1 (with targets L + 2*i and c_i),
+// where b_i < c_i. The other internal vertices have target pairs x < y with x, y < L + k, where a target L + i is a placeholder for the i-th Jacobiator
+// (to be replaced by the Leibniz rule).
+//
+// The templates are enumerated in lexicographic order of (a_0, b_0, c_0, ..., x_0, y_0, ...), directly (without generating rejected tuples), and
+// only if the in-degrees of the ground vertices are one of `in_degrees`, and at most `max_jac_indegree` arrows fall on each Jacobiator.
+inline void jacobi_leibniz_templates(size_t internal, size_t external, size_t jacobiators,
+                                     std::set< std::vector<size_t> > const& in_degrees, size_t max_jac_indegree,
+                                     std::function<void(std::vector<KontsevichGraph::VertexPair>&)> const& callback)
+{
+    size_t n = internal, k = jacobiators;
+    if (k == 0 || 2*k > n || in_degrees.empty())
+        return;
+    size_t first_jacobi_vertex = n + external - 2*k;
+
+    // Upper bounds for the partial in-degrees of the ground vertices
+    std::vector<size_t> max_in_degrees(external, 0);
+    for (auto& sector : in_degrees)
+        for (size_t v = 0; v != external && v != sector.size(); ++v)
+            max_in_degrees[v] = std::max(max_in_degrees[v], sector[v]);
+
+    size_t jacobi_length = 3*k;
+    size_t length = jacobi_length + 2*(n - 2*k);
+    std::vector<size_t> choice(length);
+    std::vector<size_t> ground_in_degrees(external, 0);
+    std::vector<size_t> jacobiator_in_degrees(k, 0);
+
+    auto emit = [&]() {
+        if (in_degrees.find(ground_in_degrees) == in_degrees.end())
+            return;
+        // First the other vertices, then the Jacobiators
+        std::vector<KontsevichGraph::VertexPair> targets(n);
+        for (size_t idx = 0; idx != n - 2*k; ++idx)
+            targets[idx] = { choice[jacobi_length + 2*idx], choice[jacobi_length + 2*idx + 1] };
+        for (size_t i = 0; i != k; ++i)
+        {
+            targets[n - 2*k + 2*i].first = KontsevichGraph::Vertex(choice[3*i]);
+            targets[n - 2*k + 2*i].second = KontsevichGraph::Vertex(choice[3*i + 1]);
+            targets[n - 2*k + 2*i + 1].first = KontsevichGraph::Vertex(first_jacobi_vertex + 2*i);
+            targets[n - 2*k + 2*i + 1].second = KontsevichGraph::Vertex(choice[3*i + 2]);
+        }
+        callback(targets);
+    };
+
+    std::function<void(size_t)> choose = [&](size_t position) {
+        if (position == length)
+        {
+            emit();
+            return;
+        }
+        bool jacobi_part = position < jacobi_length;
+        bool first_in_tuple = jacobi_part ? position % 3 == 0 : (position - jacobi_length) % 2 == 0;
+        size_t begin = first_in_tuple ? 0 : choice[position - 1] + 1; // strictly increasing within each tuple
+        size_t end = jacobi_part ? n + external : n + external - k;
+        for (size_t target = begin; target < end; ++target)
+        {
+            if (target < external)
+            {
+                if (ground_in_degrees[target] == max_in_degrees[target])
+                    continue;
+                ++ground_in_degrees[target];
+            }
+            else if (!jacobi_part && target >= first_jacobi_vertex)
+            {
+                if (jacobiator_in_degrees[target - first_jacobi_vertex] == max_jac_indegree)
+                    continue;
+                ++jacobiator_in_degrees[target - first_jacobi_vertex];
+            }
+            choice[position] = target;
+            choose(position + 1);
+            if (target < external)
+                --ground_in_degrees[target];
+            else if (!jacobi_part && target >= first_jacobi_vertex)
+                --jacobiator_in_degrees[target - first_jacobi_vertex];
+        }
+    };
+    choose(0);
+}
+
+// The (reduced) sum of graphs obtained from a template by replacing the placeholders using the Leibniz rule, and summing each Jacobiator over cyclic
+// permutations of its targets; a Jacobiator may act on itself. Only touches graphs and integers, so it is safe to call from several threads.
+inline KontsevichGraphSum<int> jacobi_leibniz_expansion(size_t internal, size_t external, size_t jacobiators, std::vector<KontsevichGraph::VertexPair> targets)
+{
+    size_t n = internal, k = jacobiators;
+    size_t first_jacobi_vertex = n + external - 2*k;
+
+    // References to the placeholder targets in the first part, and the corresponding Jacobiators
+    std::map<KontsevichGraph::Vertex*, size_t> bad_targets;
+    for (size_t idx = 0; idx != n - 2*k; ++idx)
+    {
+        if ((size_t)targets[idx].first >= first_jacobi_vertex)
+            bad_targets[&targets[idx].first] = (size_t)targets[idx].first - first_jacobi_vertex;
+        if ((size_t)targets[idx].second >= first_jacobi_vertex)
+            bad_targets[&targets[idx].second] = (size_t)targets[idx].second - first_jacobi_vertex;
+    }
+
+    KontsevichGraphSum<int> graph_sum;
+    std::vector<size_t> leibniz_sizes(bad_targets.size(), 2);
+    CartesianProduct leibniz_indices(leibniz_sizes);
+    for (auto leibniz_index = leibniz_indices.begin(); leibniz_index != leibniz_indices.end(); ++leibniz_index)
+    {
+        size_t idx = 0;
+        for (auto& bad_target : bad_targets)
+            *(bad_target.first) = KontsevichGraph::Vertex(first_jacobi_vertex + 2*(bad_target.second) + (*leibniz_index)[idx++]);
+
+        for (size_t i = 0; i != k; ++i)
+        {
+            KontsevichGraph::VertexPair& bottom = targets[n - 2*k + 2*i];
+            KontsevichGraph::VertexPair& top = targets[n - 2*k + 2*i + 1];
+            for (size_t rotation = 0; rotation != 3; ++rotation)
+            {
+                if (rotation != 0) // cyclically permute the Jacobiator targets (a, b, c) -> (b, c, a), leaving the last one in place
+                {
+                    KontsevichGraph::Vertex a = bottom.first;
+                    bottom.first = bottom.second;
+                    bottom.second = top.second;
+                    top.second = a;
+                }
+                graph_sum.push_back({ 1, KontsevichGraph(n, external, targets) });
+            }
+        }
+    }
+    graph_sum.reduce_mod_skew();
+    return graph_sum;
+}
+
+// The Leibniz graph described by a template (placeholders replaced by the "bottom" vertex L + 2*i of the Jacobiator)
+template<class T>
+LeibnizGraph<T> jacobi_leibniz_graph(size_t internal, size_t external, size_t jacobiators, std::vector<KontsevichGraph::VertexPair> targets, bool skew = false)
+{
+    size_t first_jacobi_vertex = internal + external - 2*jacobiators;
+    for (size_t idx = 0; idx != internal - 2*jacobiators; ++idx)
+    {
+        if ((size_t)targets[idx].first >= first_jacobi_vertex)
+            targets[idx].first = first_jacobi_vertex + 2*((size_t)targets[idx].first - first_jacobi_vertex);
+        if ((size_t)targets[idx].second >= first_jacobi_vertex)
+            targets[idx].second = first_jacobi_vertex + 2*((size_t)targets[idx].second - first_jacobi_vertex);
+    }
+    std::vector<KontsevichGraph::VertexPair> jacobiator_vertices;
+    for (size_t i = 0; i != jacobiators; ++i)
+        jacobiator_vertices.push_back({ first_jacobi_vertex + 2*i, first_jacobi_vertex + 2*i + 1 });
+    return LeibnizGraph<T>(KontsevichGraph(internal, external, targets, 1, true), jacobiator_vertices, skew);
+}
+
+#endif
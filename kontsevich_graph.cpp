@@ -236,6 +236,53 @@ bool KontsevichGraph::is_prime() const
     return vertex_count == d_internal;
 }
 
+// The prime factors (the connected components of the internal vertices, attached to the same ground vertices), normalized,
+// in the order of their smallest internal vertex; the sign of the graph is included in that of the first factor, so that their product is the graph.
+// A graph without internal vertices is its own factor.
+std::vector<KontsevichGraph> KontsevichGraph::prime_factors() const
+{
+    if (d_internal == 0)
+        return { *this };
+    // Label each internal vertex with the smallest internal vertex in its component
+    std::vector<size_t> component(d_internal);
+    std::iota(component.begin(), component.end(), 0);
+    std::function<size_t(size_t)> find = [&component, &find](size_t v) { return component[v] == v ? v : component[v] = find(component[v]); };
+    for (size_t i = 0; i != d_internal; ++i)
+        for (KontsevichGraph::Vertex target : { d_targets[i].first, d_targets[i].second })
+            if ((size_t)target >= d_external)
+            {
+                size_t first = find(i), second = find(target - d_external);
+                component[std::max(first, second)] = std::min(first, second);
+            }
+    std::vector<KontsevichGraph> factors;
+    std::vector<size_t> factor_index(d_internal), new_label(d_internal);
+    std::vector< std::vector<KontsevichGraph::VertexPair> > factor_targets;
+    for (size_t i = 0; i != d_internal; ++i)
+    {
+        size_t root = find(i);
+        if (root == i)
+        {
+            factor_index[i] = factor_targets.size();
+            factor_targets.push_back({});
+        }
+        new_label[i] = d_external + factor_targets[factor_index[root]].size();
+        factor_targets[factor_index[root]].push_back(d_targets[i]);
+    }
+    for (auto& targets : factor_targets)
+    {
+        for (auto& target_pair : targets)
+        {
+            if ((size_t)target_pair.first >= d_external)
+                target_pair.first = new_label[target_pair.first - d_external];
+            if ((size_t)target_pair.second >= d_external)
+                target_pair.second = new_label[target_pair.second - d_external];
+        }
+        factors.push_back(KontsevichGraph(targets.size(), d_external, targets));
+    }
+    factors.front().sign(factors.front().sign() * d_sign);
+    return factors;
+}
+
 KontsevichGraph KontsevichGraph::mirror_image() const
 {
     std::vector<KontsevichGraph::VertexPair> targets = d_targets;
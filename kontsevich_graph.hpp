@@ -8,6 +8,10 @@
 #include <set>
 #include <functional>
 #include "util/sort_pairs.hpp"
+#include "util/hash_combine.hpp"
+
+class KontsevichGraph;
+namespace std { template<> struct hash<KontsevichGraph>; }
 
 class KontsevichGraph
 {
@@ -45,6 +49,7 @@ class KontsevichGraph
     bool operator<(const KontsevichGraph& rhs) const;
     bool is_zero() const;
     bool is_prime() const;
+    std::vector<KontsevichGraph> prime_factors() const;
     bool positive_differential_order() const;
     bool has_cycles() const;
     bool has_tadpoles() const;
@@ -58,8 +63,25 @@ class KontsevichGraph
     friend std::istream& operator>>(std::istream& is, KontsevichGraph& g);
     friend bool operator==(const KontsevichGraph &lhs, const KontsevichGraph& rhs);
     friend bool operator!=(const KontsevichGraph &lhs, const KontsevichGraph& rhs);
+    friend struct std::hash<KontsevichGraph>;
 };
 
+namespace std
+{
+    template<>
+    struct hash<KontsevichGraph>
+    {
+        size_t operator()(const KontsevichGraph& g) const
+        {
+            size_t seed = g.d_external;
+            for (auto& target_pair : g.d_targets)
+                hash_combine(seed, ((size_t)(unsigned char)target_pair.first << 8) | (unsigned char)target_pair.second);
+            hash_combine(seed, (size_t)g.d_sign);
+            return seed;
+        }
+    };
+}
+
 inline size_t apply_permutation(size_t internal, size_t external, std::vector<KontsevichGraph::VertexPair>& targets, std::vector<KontsevichGraph::Vertex>& permutation)
 {
     // Relabel elements of target pairs
@@ -2,57 +2,174 @@
 #define INCLUDED_KONTSEVICH_GRAPH_OPERATOR_
 
 #include <ginac/ginac.h>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <sstream>
+#include <cstdlib>
 #include "kontsevich_graph_series.hpp"
 #include "util/cartesian_product.hpp"
 #include "util/poisson_structure.hpp"
+#include "util/poisson_structure_evaluator.hpp"
+#include "util/work_queue.hpp"
 
 typedef std::multiset<size_t> multi_index;
 typedef std::vector<multi_index> multi_indexes;
 
-void map_operator_coefficients_from_graph(KontsevichGraph graph, PoissonStructure& poisson, std::function<void(multi_indexes, GiNaC::ex)> fun)
+inline bool is_zero_value(GiNaC::ex const& value) { return value.is_zero(); }
+
+template<class T>
+bool is_zero_value(T const& value) { return NumericTraits<T>::is_zero(value); }
+
+// Calls fun for each assignment of coordinate indices to the arrows of the graph, with the product of the values (of type T) of the
+// corresponding bivector components (derivatives), given by factor_value(key), e.g. at a point; see map_operator_coefficients_from_graph.
+template<class T, class Factor>
+void map_operator_values_from_graph(KontsevichGraph graph, PoissonStructure& poisson, Factor factor_value, std::function<void(multi_indexes, T)> fun, bool antisymmetric)
 {
     multi_indexes external_indices_template(graph.external());
     for (size_t n = 0; n != graph.external(); ++n)
         for (size_t j : graph.neighbors_in(n))
             external_indices_template[n].insert( ((size_t)graph.targets(j).first == n) ? 2*(j-graph.external()) : 2*(j-graph.external()) + 1 );
 
-    GiNaC::ex result = 0;
     size_t dimension = poisson.coordinates.size();
-    std::vector<size_t> max_index(2*graph.internal(), dimension);
-    CartesianProduct index_product(max_index);
-    for (auto indices = index_product.begin(); indices != index_product.end(); ++indices)
+    if (poisson.bivector_dependencies.size() != dimension)
     {
-        multi_indexes external_indices(graph.external());
-        for (size_t n = 0; n != graph.external(); ++n)
-            for (size_t j : external_indices_template[n])
-                external_indices[n].insert((*indices)[j]);
+        poisson.bivector_dependencies.assign(dimension, std::vector< std::vector<bool> >(dimension, std::vector<bool>(dimension)));
+        for (size_t i = 0; i != dimension; ++i)
+            for (size_t j = 0; j != dimension; ++j)
+                for (size_t l = 0; l != dimension; ++l)
+                {
+                    BivectorDerivativeKey key(i, j);
+                    key.add_derivative(l);
+                    poisson.bivector_dependencies[i][j][l] = !poisson.bivector_derivative(key).is_zero();
+                }
+    }
+
+    // Index positions: 2*k and 2*k + 1 for the arrows of the k-th internal vertex; the factor of vertex k also uses its incoming positions
+    size_t internal = graph.internal(), positions = 2*internal;
+    std::vector< std::vector<size_t> > incoming_positions(internal);
+    for (size_t k = 0; k != internal; ++k)
+        for (size_t j : graph.neighbors_in(graph.external() + k))
+            incoming_positions[k].push_back( ((size_t)graph.targets(j).first == graph.external() + k) ? 2*(j-graph.external()) : 2*(j-graph.external()) + 1 );
 
-        GiNaC::ex summand = graph.sign();
-        for (size_t n : graph.internal_vertices())
+    // Checks to perform after choosing the index in a position: vertices whose components are known, incoming arrows whose index
+    // (and target component) are known, and vertices whose factors are known.
+    // In the antisymmetric mode the pair of indices of a vertex is only known (in its orientation) at the second position of the pair.
+    auto check_position = [antisymmetric](size_t position) { return antisymmetric ? (position | 1) : position; };
+    std::vector< std::vector<size_t> > component_checks(positions), factor_checks(positions);
+    std::vector< std::vector< std::pair<size_t, size_t> > > dependency_checks(positions);
+    for (size_t k = 0; k != internal; ++k)
+    {
+        size_t complete = 2*k + 1;
+        for (size_t q : incoming_positions[k])
         {
-            std::pair<size_t, size_t> bivector_indices { (*indices)[2*(n-graph.external())], (*indices)[2*(n-graph.external()) + 1] };
-            multi_index partial_derivatives;
-            for (size_t j : graph.neighbors_in(n))
+            dependency_checks[check_position(std::max(2*k + 1, q))].push_back({ k, q });
+            complete = std::max(complete, q);
+        }
+        component_checks[2*k + 1].push_back(k);
+        factor_checks[check_position(complete)].push_back(k);
+    }
+
+    std::vector<size_t> indices(positions);
+    std::vector<bool> swapped(internal); // in the antisymmetric mode: whether indices[2*k] > indices[2*k + 1]
+    auto component = [&](size_t k) -> std::pair<size_t, size_t> {
+        return swapped[k] ? std::make_pair(indices[2*k + 1], indices[2*k]) : std::make_pair(indices[2*k], indices[2*k + 1]);
+    };
+    // Performs the checks after the index in a position is chosen, and continues with the next position if the product does not vanish
+    std::function<void(size_t, T const&)> choose;
+    auto check = [&](size_t position, T const& product) {
+        for (size_t k : component_checks[position])
+            if (poisson.bivector[component(k).first][component(k).second].is_zero())
+                return;
+        for (auto& check : dependency_checks[position])
+            if (!poisson.bivector_dependencies[component(check.first).first][component(check.first).second][indices[check.second]])
+                return;
+        T summand = product;
+        for (size_t k : factor_checks[position])
+        {
+            BivectorDerivativeKey key(component(k).first, component(k).second);
+            for (size_t q : incoming_positions[k])
+                key.add_derivative(indices[q]);
+            auto const& factor = factor_value(key);
+            if (is_zero_value(factor))
+                return;
+            summand *= factor;
+            if (swapped[k])
+                summand = -summand;
+        }
+        choose(position + 1, summand);
+    };
+    choose = [&](size_t position, T const& product) {
+        if (position == positions)
+        {
+            multi_indexes external_indices(graph.external());
+            for (size_t n = 0; n != graph.external(); ++n)
+                for (size_t j : external_indices_template[n])
+                    external_indices[n].insert(indices[j]);
+            fun(external_indices, product);
+            return;
+        }
+        if (!antisymmetric)
+        {
+            for (size_t index = 0; index != dimension; ++index)
             {
-                size_t incoming_index = ((size_t)graph.targets(j).first == n) ? (*indices)[2*(j-graph.external())] : (*indices)[2*(j-graph.external()) + 1];
-                partial_derivatives.insert(incoming_index);
+                indices[position] = index;
+                check(position, product);
             }
-            try {
-                summand *= poisson.bivector_derivatives_cache.at({ bivector_indices, partial_derivatives });
+        }
+        else if (position % 2 == 0) // the smaller index of the pair
+        {
+            for (size_t index = 0; index + 1 < dimension; ++index)
+            {
+                indices[position] = index;
+                choose(position + 1, product);
             }
-            catch (std::out_of_range)
+        }
+        else // the larger index of the pair, and the orientation
+        {
+            size_t k = position / 2, smaller = indices[position - 1];
+            for (size_t index = smaller + 1; index < dimension; ++index)
             {
-                GiNaC::ex factor = poisson.bivector[bivector_indices.first][bivector_indices.second];
-                for (size_t j : partial_derivatives)
-                {
-                    factor = diff(factor, poisson.coordinates[j]);
-                }
-                summand *= factor;
-                poisson.bivector_derivatives_cache[{ bivector_indices, partial_derivatives }] = factor;
+                indices[position - 1] = smaller;
+                indices[position] = index;
+                swapped[k] = false;
+                check(position, product);
+                indices[position - 1] = index;
+                indices[position] = smaller;
+                swapped[k] = true;
+                check(position, product);
             }
+            indices[position - 1] = smaller;
+            swapped[k] = false;
         }
-        fun(external_indices, summand);
-    }
+    };
+    choose(0, T(graph.sign()));
+}
+
+// Calls fun for each assignment of coordinate indices to the arrows of the graph with a nonzero product of bivector components (derivatives),
+// in lexicographic order. The indices are chosen one arrow at a time, and a branch is abandoned as soon as a factor is known to vanish:
+// a zero component, a derivative by a coordinate the component does not depend on, or (when all its indices are known) a zero derivative.
+//
+// If antisymmetric is true, the bivector is assumed to be skew-symmetric (P^{ii} = 0 and P^{ji} = -P^{ij}): then only the index pairs i < j
+// are chosen for the arrows of each internal vertex, and the swapped assignment (j, i) is obtained from the same component, with a minus sign.
+// The same summands are passed to fun, but not in lexicographic order.
+void map_operator_coefficients_from_graph(KontsevichGraph graph, PoissonStructure& poisson, std::function<void(multi_indexes, GiNaC::ex)> fun, bool antisymmetric = false)
+{
+    map_operator_values_from_graph<GiNaC::ex>(graph, poisson, [&poisson](BivectorDerivativeKey const& key) -> GiNaC::ex const& { return poisson.bivector_derivative(key); }, fun, antisymmetric);
+}
+
+// As map_operator_coefficients_from_graph, with the (numeric) values of the bivector components and their derivatives at the point of the evaluator
+template<class T>
+void map_operator_values_at_point(KontsevichGraph graph, PoissonStructureEvaluator<T>& evaluator, std::function<void(multi_indexes, T)> fun, bool antisymmetric = false)
+{
+    map_operator_values_from_graph<T>(graph, evaluator.poisson(), [&evaluator](BivectorDerivativeKey const& key) -> T const& { return evaluator.bivector_derivative(key); }, fun, antisymmetric);
+}
+
+// As map_operator_values_at_point, at all points of the evaluator at once: the enumeration is shared, and only the products are per point
+template<class T>
+void map_operator_values_at_points(KontsevichGraph graph, PoissonStructureBatchEvaluator<T>& evaluator, std::function<void(multi_indexes, PointBatch<T>)> fun, bool antisymmetric = false)
+{
+    map_operator_values_from_graph< PointBatch<T> >(graph, evaluator.poisson(), [&evaluator](BivectorDerivativeKey const& key) -> PointBatch<T> const& { return evaluator.bivector_derivative(key); }, fun, antisymmetric);
 }
 
 GiNaC::ex operator_from_graph(KontsevichGraph graph, PoissonStructure& poisson, std::vector<GiNaC::ex> arguments)
@@ -80,24 +197,363 @@ void operator_coefficient_from_graph(KontsevichGraph graph, PoissonStructure& po
     });
 }
 
-GiNaC::ex evaluate(KontsevichGraphSum<GiNaC::ex> terms, PoissonStructure& poisson, std::vector<GiNaC::ex> arguments)
+// Encoding of the derivatives of the arguments in the names of archived expressions: the indices of each argument, followed by "|"
+std::string multi_indexes_name(multi_indexes const& derivatives)
 {
-    GiNaC::ex total = 0;
-    for (auto& term : terms)
+    std::string name;
+    for (multi_index const& indices : derivatives)
     {
-        total += term.first * operator_from_graph(term.second, poisson, arguments);
+        for (size_t idx : indices)
+            name += std::to_string(idx) + " ";
+        name += "|";
     }
-    return total;
+    return name;
 }
 
-std::map<multi_indexes, GiNaC::ex> evaluate_coefficients(KontsevichGraphSum<GiNaC::ex> terms, PoissonStructure& poisson)
+multi_indexes multi_indexes_from_name(std::string const& name)
+{
+    multi_indexes derivatives;
+    std::istringstream name_stream(name);
+    std::string argument;
+    while (std::getline(name_stream, argument, '|'))
+    {
+        std::istringstream argument_stream(argument);
+        multi_index indices;
+        size_t index;
+        while (argument_stream >> index)
+            indices.insert(index);
+        derivatives.push_back(indices);
+    }
+    return derivatives;
+}
+
+// Operator coefficients of graphs, computed from their prime factors: the coefficients of each distinct prime factor (up to sign), and those of
+// each distinct product of the first factors of a graph (in sorted order), are computed once for the Poisson structure and shared between graphs.
+// The bivector is assumed to be skew-symmetric, as in the normalization of graphs.
+class GraphOperatorCache
+{
+    typedef std::map<multi_indexes, GiNaC::ex> Coefficients;
+
+    PoissonStructure& d_poisson;
+    bool d_antisymmetric;
+    std::map<KontsevichGraph, Coefficients> d_factors; // normalized prime graph with sign 1 -> coefficients
+    std::map<std::vector<KontsevichGraph>, Coefficients> d_products; // sorted factors (not all factors of a graph) -> coefficients of the product
+    std::set<KontsevichGraph> d_computed; // factors computed (rather than loaded) since the last save_computed
+
+    Coefficients const& factor_coefficients(KontsevichGraph const& factor)
+    {
+        auto cached = d_factors.find(factor);
+        if (cached != d_factors.end())
+            return cached->second;
+        Coefficients coefficients;
+        map_operator_coefficients_from_graph(factor, d_poisson, [&coefficients](multi_indexes derivatives, GiNaC::ex summand) {
+            coefficients[derivatives] += summand;
+        }, d_antisymmetric);
+        for (auto it = coefficients.begin(); it != coefficients.end(); )
+            it = it->second.is_zero() ? coefficients.erase(it) : std::next(it);
+        d_computed.insert(factor);
+        return d_factors.insert({ factor, coefficients }).first->second;
+    }
+
+    // Writes the components and the coefficients of the selected factors as a GiNaC archive
+    void save_factors(std::ostream& os, std::function<bool(KontsevichGraph const&)> const& selected) const
+    {
+        GiNaC::archive operators_archive;
+        for (size_t i = 0; i != d_poisson.coordinates.size(); ++i)
+            for (size_t j = 0; j != d_poisson.coordinates.size(); ++j)
+                operators_archive.archive_ex(d_poisson.bivector[i][j], ("P " + std::to_string(i) + " " + std::to_string(j)).c_str());
+        for (auto& factor : d_factors)
+        {
+            if (!selected(factor.first))
+                continue;
+            std::string encoding = factor.first.encoding();
+            operators_archive.archive_ex(factor.second.size(), ("G " + encoding).c_str());
+            for (auto& entry : factor.second)
+                operators_archive.archive_ex(entry.second, ("C " + encoding + ":" + multi_indexes_name(entry.first)).c_str());
+        }
+        os << operators_archive;
+    }
+
+    // Calls fun with the products of the coefficients of the two operators, for the union of the derivatives
+    static void map_products(Coefficients const& first, Coefficients const& second, std::function<void(multi_indexes, GiNaC::ex)> const& fun)
+    {
+        for (auto& left : first)
+            for (auto& right : second)
+            {
+                multi_indexes derivatives = left.first;
+                for (size_t n = 0; n != derivatives.size(); ++n)
+                    derivatives[n].insert(right.first[n].begin(), right.first[n].end());
+                fun(derivatives, left.second * right.second);
+            }
+    }
+
+    // The coefficients of the product of the first count factors
+    Coefficients const& product_coefficients(std::vector<KontsevichGraph> const& factors, size_t count)
+    {
+        if (count == 1)
+            return factor_coefficients(factors[0]);
+        std::vector<KontsevichGraph> key(factors.begin(), factors.begin() + count);
+        auto cached = d_products.find(key);
+        if (cached != d_products.end())
+            return cached->second;
+        Coefficients coefficients;
+        map_products(product_coefficients(factors, count - 1), factor_coefficients(factors[count - 1]), [&coefficients](multi_indexes derivatives, GiNaC::ex summand) {
+            coefficients[derivatives] += summand;
+        });
+        return d_products.insert({ key, coefficients }).first->second;
+    }
+
+    public:
+    // If antisymmetric is true, the factors are evaluated in the antisymmetric mode of map_operator_coefficients_from_graph
+    GraphOperatorCache(PoissonStructure& poisson, bool antisymmetric = false)
+    : d_poisson(poisson), d_antisymmetric(antisymmetric)
+    {}
+
+    size_t factors() const { return d_factors.size(); }
+
+    // Writes the coefficients of the prime factors computed so far as a GiNaC archive, together with the components of the Poisson structure
+    // (to recognize it): for each factor, "G <graph encoding>" (with the number of coefficients), and "C <graph encoding>:<derivatives>" for each coefficient
+    void save(std::ostream& os) const
+    {
+        save_factors(os, [](KontsevichGraph const&) { return true; });
+    }
+
+    // Writes (as save) only the factors computed since the last call, e.g. to pass them on from a worker process
+    void save_computed(std::ostream& os)
+    {
+        save_factors(os, [this](KontsevichGraph const& factor) { return d_computed.find(factor) != d_computed.end(); });
+        d_computed.clear();
+    }
+
+    // Adds the coefficients in an archive written by save to the cache (factors that are already known are kept);
+    // returns false (and adds nothing) if the archive belongs to a different Poisson structure or cannot be read
+    bool load(std::istream& is)
+    {
+        try {
+            GiNaC::archive operators_archive;
+            is >> operators_archive;
+            if (!is)
+                return false;
+            GiNaC::lst symbols = d_poisson.symbols();
+            size_t dimension = d_poisson.coordinates.size(), components = 0;
+            std::map<KontsevichGraph, Coefficients> factors;
+            for (size_t idx = 0; idx != operators_archive.num_expressions(); ++idx)
+            {
+                std::string name;
+                GiNaC::ex expression = operators_archive.unarchive_ex(symbols, name, idx);
+                std::string kind = name.substr(0, 2), rest = name.substr(std::min(name.size(), (size_t)2));
+                if (kind == "P ")
+                {
+                    std::istringstream name_stream(rest);
+                    size_t i, j;
+                    name_stream >> i >> j;
+                    if (!name_stream || i >= dimension || j >= dimension || !expression.is_equal(d_poisson.bivector[i][j]))
+                        return false;
+                    ++components;
+                    continue;
+                }
+                size_t colon = rest.find(':');
+                std::istringstream graph_stream(rest.substr(0, colon));
+                KontsevichGraph factor;
+                graph_stream >> factor;
+                if (graph_stream.fail())
+                    return false;
+                if (kind == "G ")
+                    factors[factor];
+                else if (kind == "C " && colon != std::string::npos)
+                    factors[factor][multi_indexes_from_name(rest.substr(colon + 1))] = expression;
+                else
+                    return false;
+            }
+            if (components != dimension * dimension)
+                return false;
+            d_factors.insert(factors.begin(), factors.end());
+            return true;
+        }
+        catch (std::exception const&) // e.g. a truncated or foreign file
+        {
+            return false;
+        }
+    }
+
+    // As map_operator_coefficients_from_graph (with summands that are sums of products of those, and in no particular order)
+    void map_coefficients(KontsevichGraph const& graph, std::function<void(multi_indexes, GiNaC::ex)> fun)
+    {
+        std::vector<KontsevichGraph> factors = graph.prime_factors();
+        int sign = 1;
+        for (KontsevichGraph& factor : factors)
+        {
+            sign *= factor.sign();
+            factor.sign(1);
+        }
+        if (sign == 0)
+            return;
+        std::sort(factors.begin(), factors.end());
+        auto signed_fun = [&fun, sign](multi_indexes derivatives, GiNaC::ex summand) { fun(derivatives, sign * summand); };
+        if (factors.size() == 1)
+        {
+            for (auto& entry : factor_coefficients(factors[0]))
+                signed_fun(entry.first, entry.second);
+        }
+        else // the product with all factors is not kept: it is shared by no other graph
+            map_products(product_coefficients(factors, factors.size() - 1), factor_coefficients(factors.back()), signed_fun);
+    }
+};
+
+// The coefficients of the graph operators of the terms (see GraphOperatorCache, e.g. loaded from an earlier run), combined linearly
+std::map<multi_indexes, GiNaC::ex> evaluate_coefficients(KontsevichGraphSum<GiNaC::ex> terms, GraphOperatorCache& operators)
 {
     std::map<multi_indexes, GiNaC::ex> accumulator;
     for (auto& term : terms)
     {
-        operator_coefficient_from_graph(term.second, poisson, term.first, accumulator);
+        operators.map_coefficients(term.second, [&term, &accumulator](multi_indexes derivatives, GiNaC::ex summand) {
+            accumulator[derivatives] += term.first * summand;
+        });
     }
     return accumulator;
 }
 
+std::map<multi_indexes, GiNaC::ex> evaluate_coefficients(KontsevichGraphSum<GiNaC::ex> terms, PoissonStructure& poisson)
+{
+    GraphOperatorCache operators(poisson);
+    return evaluate_coefficients(terms, operators);
+}
+
+GiNaC::ex evaluate(KontsevichGraphSum<GiNaC::ex> terms, PoissonStructure& poisson, std::vector<GiNaC::ex> arguments)
+{
+    GiNaC::ex total = 0;
+    for (auto& entry : evaluate_coefficients(terms, poisson))
+    {
+        GiNaC::ex tail = 1;
+        for (size_t m = 0; m != arguments.size(); ++m)
+        {
+            GiNaC::ex factor = arguments[m];
+            for (size_t idx : entry.first[m])
+                factor = factor.diff(poisson.coordinates[idx]);
+            tail *= factor;
+        }
+        total += entry.second * tail;
+    }
+    return total;
+}
+
+// Writes the coefficients as a GiNaC archive, with the derivatives of the arguments encoded in the names (see multi_indexes_name)
+void save_operator_coefficients(std::ostream& os, std::map<multi_indexes, GiNaC::ex> const& coefficients)
+{
+    GiNaC::archive coefficients_archive;
+    for (auto& entry : coefficients)
+    {
+        coefficients_archive.archive_ex(entry.second, multi_indexes_name(entry.first).c_str());
+    }
+    os << coefficients_archive;
+}
+
+// Adds the coefficients in an archive written by save_operator_coefficients (in terms of the given symbols) to the accumulator;
+// returns false if the archive cannot be read
+bool add_operator_coefficients(std::istream& is, GiNaC::lst const& symbols, std::map<multi_indexes, GiNaC::ex>& accumulator)
+{
+    GiNaC::archive coefficients_archive;
+    is >> coefficients_archive;
+    if (!is)
+        return false;
+    for (size_t idx = 0; idx != coefficients_archive.num_expressions(); ++idx)
+    {
+        std::string name;
+        GiNaC::ex coefficient = coefficients_archive.unarchive_ex(symbols, name, idx);
+        accumulator[multi_indexes_from_name(name)] += coefficient;
+    }
+    return true;
+}
+
+// Computing a sum of operator coefficients in several processes: the terms are divided into shards (by their index modulo the number of shards),
+// which are claimed from a work queue in a directory by forked worker processes, and by any other process working on the same directory (e.g.
+// on another machine, through a shared filesystem). The partial coefficients of each shard are written to the directory, and summed at the end.
+struct ShardingOptions
+{
+    size_t processes = 1;
+    size_t shards = 0; // 0 means four per process
+    std::string directory; // empty means a temporary directory, removed afterwards
+    std::string manifest;  // identifies the computation (program, input, Poisson structure); a directory used for a different one is refused
+
+    bool enabled() const { return processes > 1 || !directory.empty(); }
+};
+
+// The sum of the coefficients added to an (empty) accumulator by add_term(index, accumulator) for all term indices, computed as in ShardingOptions.
+// The task names start with name, which should identify the sum within the computation, and include the number of shards;
+// the coefficients are read back in terms of the given symbols.
+// If operators is set, add_term should use it; the factors each shard computes are then attached to its result and added to it in the parent
+// (so that a cache filled in forked workers is not lost; an attachment that cannot be read is skipped).
+// Shards claimed by workers that died on this host are done again; while waiting for shards claimed on other hosts, the tasks are reported on stderr.
+// Throws std::runtime_error if the directory belongs to a different computation (see DirectoryWorkQueue::bind), a worker fails, a shard is
+// abandoned or a result cannot be read.
+std::map<multi_indexes, GiNaC::ex> sharded_operator_coefficients(std::string const& name, size_t terms, std::function<void(size_t, std::map<multi_indexes, GiNaC::ex>&)> add_term,
+                                                                 GiNaC::lst const& symbols, ShardingOptions const& options, GraphOperatorCache* operators = nullptr)
+{
+    std::string directory = options.directory;
+    if (directory.empty())
+    {
+        char temporary[] = "/tmp/kontsevich_shards_XXXXXX";
+        if (mkdtemp(temporary) == nullptr)
+            throw std::runtime_error("sharded_operator_coefficients: cannot create a temporary directory");
+        directory = temporary;
+    }
+    DirectoryWorkQueue queue(directory);
+    queue.bind(options.manifest);
+    size_t shards = options.shards != 0 ? options.shards : 4 * std::max(options.processes, (size_t)1);
+    auto task = [&name, shards](size_t shard) { return name + "." + std::to_string(shard) + "-of-" + std::to_string(shards); };
+    // Computes a claimed shard, giving up the claim if that fails
+    auto compute = [&](size_t shard) {
+        try {
+            std::map<multi_indexes, GiNaC::ex> accumulator;
+            for (size_t index = shard; index < terms; index += shards)
+                add_term(index, accumulator);
+            if (operators != nullptr)
+            {
+                std::ostringstream computed;
+                operators->save_computed(computed);
+                queue.attach(task(shard), "operators", computed.str());
+            }
+            std::ostringstream result;
+            save_operator_coefficients(result, accumulator);
+            queue.complete(task(shard), result.str());
+        }
+        catch (...)
+        {
+            queue.release(task(shard));
+            throw;
+        }
+    };
+    // Shards whose worker died (on this host, e.g. in an earlier run with the same directory) are done again
+    bool success = fork_workers(options.processes, [&]() {
+        for (size_t shard = 0; shard != shards; ++shard)
+            if (queue.claim(task(shard)) || queue.reclaim(task(shard)))
+                compute(shard);
+    });
+    if (!success)
+        throw std::runtime_error("sharded_operator_coefficients: a worker failed");
+    std::map<multi_indexes, GiNaC::ex> coefficients;
+    for (size_t shard = 0; shard != shards; ++shard)
+    {
+        if (queue.reclaim(task(shard))) // e.g. abandoned by a worker on this host of another run
+            compute(shard);
+        queue.wait(task(shard));
+        std::istringstream result(queue.result(task(shard)));
+        if (!add_operator_coefficients(result, symbols, coefficients))
+            throw std::runtime_error("sharded_operator_coefficients: cannot read the result of " + task(shard));
+        if (operators != nullptr)
+        {
+            std::istringstream computed(queue.attachment(task(shard), "operators"));
+            operators->load(computed); // if it cannot be read, the cache only misses those factors
+        }
+    }
+    if (options.directory.empty())
+    {
+        for (size_t shard = 0; shard != shards; ++shard)
+            queue.remove(task(shard), { "operators" });
+        std::remove((directory + "/MANIFEST").c_str());
+        rmdir(directory.c_str());
+    }
+    return coefficients;
+}
+
 #endif
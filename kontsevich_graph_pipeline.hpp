@@ -0,0 +1,52 @@
+#ifndef INCLUDED_KONTSEVICH_GRAPH_PIPELINE_H_
+#define INCLUDED_KONTSEVICH_GRAPH_PIPELINE_H_
+
+#include "kontsevich_graph_series.hpp"
+#include <istream>
+#include <ostream>
+#include <string>
+#include <functional>
+
+// Streaming alternative to "read the whole series, transform, print":
+//
+//   reader thread --> normalizer threads --> this thread --> writer thread
+//    (raw lines)       (parse + normalize)    (parse coefficients,
+//                                              transform, aggregate)
+//
+// The stages are connected by bounded queues, so a fast reader waits for the slower stages instead of filling memory.
+// Coefficients are only touched on the calling thread (e.g. GiNaC is not thread-safe).
+template<class T>
+class KontsevichGraphPipeline
+{
+    std::function<T(std::string)> d_parser;
+    std::function<bool(KontsevichGraph, size_t)> d_filter;
+    size_t d_normalizers;
+    size_t d_batch_size = 512;     // lines per item in the queues
+    size_t d_queue_capacity = 16;  // items per queue
+
+    public:
+    typedef typename KontsevichGraphSum<T>::Term Term;
+    typedef std::function<void(std::string const&)> Emit;
+
+    KontsevichGraphPipeline(std::function<T(std::string)> const& parser, std::function<bool(KontsevichGraph, size_t)> const& filter = nullptr, size_t normalizers = 0);
+
+    // Calls on_order(order, emit) at each "h^n:" line, on_term(order, term, emit) for each term (in file order),
+    // and on_end(order, emit) after the last line; the strings passed to emit are written to os.
+    void run(std::istream& is, std::ostream& os,
+             std::function<void(size_t, Emit const&)> const& on_order,
+             std::function<void(size_t, Term&, Emit const&)> const& on_term,
+             std::function<void(size_t, Emit const&)> const& on_end = nullptr) const;
+
+    // Per-term transformation; writes "h^n:" headers like the tools do (all orders up to the last one).
+    void map_terms(std::istream& is, std::ostream& os, std::function<void(size_t, Term&, Emit const&)> const& transform) const;
+
+    // Same as from_istream followed by reduce_mod_skew, but only the distinct graphs are kept in memory.
+    KontsevichGraphSeries<T> reduce_mod_skew(std::istream& is) const;
+
+    private:
+    void consume(std::istream& is, std::function<void(KontsevichGraphSeriesLine&)> const& consumer) const;
+};
+
+#include "kontsevich_graph_pipeline.tpp"
+
+#endif
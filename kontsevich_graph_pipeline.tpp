@@ -0,0 +1,211 @@
+#include "kontsevich_graph_pipeline.hpp"
+#include "util/bounded_queue.hpp"
+#include "util/parallel.hpp"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <map>
+
+template <class T>
+KontsevichGraphPipeline<T>::KontsevichGraphPipeline(std::function<T(std::string)> const& parser, std::function<bool(KontsevichGraph, size_t)> const& filter, size_t normalizers)
+: d_parser(parser), d_filter(filter), d_normalizers(normalizers == 0 ? hardware_threads() : normalizers)
+{}
+
+template <class T>
+void KontsevichGraphPipeline<T>::consume(std::istream& is, std::function<void(KontsevichGraphSeriesLine&)> const& consumer) const
+{
+    // Batches are numbered by the reader, so that the output of the normalizers can be put back in file order
+    typedef std::pair< size_t, std::vector<std::string> > RawBatch;
+    typedef std::pair< size_t, std::vector<KontsevichGraphSeriesLine> > Batch;
+    BoundedQueue<RawBatch> raw(d_queue_capacity);
+    BoundedQueue<Batch> normalized(d_queue_capacity);
+
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+    auto fail = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        raw.abort();
+        normalized.abort();
+    };
+
+    std::thread reader([&]() {
+        try {
+            size_t sequence = 0;
+            RawBatch batch(sequence, { });
+            for (std::string line; getline(is, line); )
+            {
+                batch.second.push_back(line);
+                if (batch.second.size() == d_batch_size)
+                {
+                    if (!raw.push(std::move(batch)))
+                        return;
+                    batch = RawBatch(++sequence, { });
+                }
+            }
+            if (!batch.second.empty())
+                raw.push(std::move(batch));
+            raw.close();
+        }
+        catch (...)
+        {
+            fail();
+        }
+    });
+
+    std::atomic<size_t> running(d_normalizers);
+    std::vector<std::thread> normalizers;
+    for (size_t t = 0; t != d_normalizers; ++t)
+    {
+        normalizers.push_back(std::thread([&]() {
+            try {
+                RawBatch raw_batch;
+                bool open = true;
+                while (open && raw.pop(raw_batch))
+                {
+                    Batch batch(raw_batch.first, { });
+                    batch.second.reserve(raw_batch.second.size());
+                    for (std::string const& line : raw_batch.second)
+                    {
+                        KontsevichGraphSeriesLine parsed;
+                        if (parsed.parse(line))
+                            batch.second.push_back(std::move(parsed));
+                    }
+                    open = normalized.push(std::move(batch));
+                }
+            }
+            catch (...)
+            {
+                fail();
+            }
+            if (--running == 0)
+                normalized.close();
+        }));
+    }
+
+    try {
+        std::map< size_t, std::vector<KontsevichGraphSeriesLine> > pending;
+        size_t next_sequence = 0;
+        Batch batch;
+        while (normalized.pop(batch))
+        {
+            pending[batch.first] = std::move(batch.second);
+            for (auto it = pending.find(next_sequence); it != pending.end(); it = pending.find(++next_sequence))
+            {
+                for (KontsevichGraphSeriesLine& line : it->second)
+                    consumer(line);
+                pending.erase(it);
+            }
+        }
+    }
+    catch (...)
+    {
+        fail();
+    }
+
+    reader.join();
+    for (auto& normalizer : normalizers)
+        normalizer.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+template <class T>
+void KontsevichGraphPipeline<T>::run(std::istream& is, std::ostream& os,
+                                     std::function<void(size_t, Emit const&)> const& on_order,
+                                     std::function<void(size_t, Term&, Emit const&)> const& on_term,
+                                     std::function<void(size_t, Emit const&)> const& on_end) const
+{
+    BoundedQueue<std::string> output(d_queue_capacity);
+    std::thread writer([&os, &output]() {
+        std::string text;
+        while (output.pop(text))
+            os << text;
+        os.flush();
+    });
+    std::string buffer;
+    Emit emit = [&buffer, &output](std::string const& text) {
+        buffer += text;
+        if (buffer.size() >= 65536)
+        {
+            output.push(std::move(buffer));
+            buffer.clear();
+        }
+    };
+    try {
+        size_t order = 0;
+        consume(is, [&](KontsevichGraphSeriesLine& line) {
+            if (line.is_order)
+            {
+                order = line.order;
+                if (on_order)
+                    on_order(order, emit);
+                return;
+            }
+            if (d_filter && !d_filter(line.graph, order))
+                return;
+            Term term(d_parser(line.coefficient), line.graph);
+            on_term(order, term, emit);
+        });
+        if (on_end)
+            on_end(order, emit);
+    }
+    catch (...)
+    {
+        output.close();
+        writer.join();
+        throw;
+    }
+    output.push(std::move(buffer));
+    output.close();
+    writer.join();
+}
+
+template <class T>
+void KontsevichGraphPipeline<T>::map_terms(std::istream& is, std::ostream& os, std::function<void(size_t, Term&, Emit const&)> const& transform) const
+{
+    // Print "h^0:", ..., "h^n:" as soon as order n is reached (if orders occur out of order, the header is repeated)
+    size_t next_header = 0;
+    auto headers = [&next_header](size_t order, Emit const& emit) {
+        if (order + 1 < next_header)
+            emit("h^" + std::to_string(order) + ":\n");
+        for (; next_header <= order; ++next_header)
+            emit("h^" + std::to_string(next_header) + ":\n");
+        if (order + 1 < next_header)
+            next_header = order + 1;
+    };
+    run(is, os, headers,
+        [&headers, &transform](size_t order, Term& term, Emit const& emit) {
+            headers(order, emit);
+            transform(order, term, emit);
+        },
+        headers);
+}
+
+template <class T>
+KontsevichGraphSeries<T> KontsevichGraphPipeline<T>::reduce_mod_skew(std::istream& is) const
+{
+    std::map< size_t, KontsevichGraphSumAccumulator<T> > accumulators;
+    size_t order = 0;
+    consume(is, [this, &accumulators, &order](KontsevichGraphSeriesLine& line) {
+        if (line.is_order)
+        {
+            accumulators[order];
+            order = line.order;
+            return;
+        }
+        if (d_filter && !d_filter(line.graph, order))
+            return;
+        accumulators[order].add({ d_parser(line.coefficient), line.graph });
+    });
+    accumulators[order]; // the last one
+    KontsevichGraphSeries<T> graph_series;
+    for (auto& entry : accumulators)
+        graph_series[entry.first] = entry.second.sum();
+    graph_series.precision(order);
+    return graph_series;
+}
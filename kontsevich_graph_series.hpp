@@ -9,6 +9,17 @@
 template<class T> class KontsevichGraphSeries;
 template<class T> std::ostream& operator<<(std::ostream&, const KontsevichGraphSeries<T>&);
 
+// One line of a graph series file: either the start of an order "h^n:", or a graph with its coefficient (not yet parsed)
+struct KontsevichGraphSeriesLine
+{
+    bool is_order = false;
+    size_t order = 0;
+    KontsevichGraph graph;
+    std::string coefficient;
+
+    bool parse(std::string const& line); // returns false for empty lines and comments
+};
+
 template<class T>
 class KontsevichGraphSeries : public std::map< size_t, KontsevichGraphSum<T> >
 {
@@ -31,6 +42,7 @@ class KontsevichGraphSeries : public std::map< size_t, KontsevichGraphSum<T> >
     void reduce_mod_skew();
 
     static KontsevichGraphSeries<T> from_istream(std::istream& is, std::function<T(std::string)> const& parser, std::function<bool(KontsevichGraph, size_t)> const& filter = nullptr);
+    static KontsevichGraphSeries<T> from_file(std::string const& filename, std::function<T(std::string)> const& parser, std::function<bool(KontsevichGraph, size_t)> const& filter = nullptr, size_t threads = 0);
 
     friend std::ostream& operator<< <>(std::ostream& os, const KontsevichGraphSeries<T>& series);
 };
@@ -1,7 +1,26 @@
 #include "kontsevich_graph_series.hpp"
 #include "util/cartesian_product.hpp"
+#include "util/mapped_file.hpp"
+#include "util/parallel.hpp"
 #include <sstream>
 
+inline bool KontsevichGraphSeriesLine::parse(std::string const& line)
+{
+    if (line.length() == 0 || line[0] == '#') // also skip comments
+        return false;
+    is_order = line[0] == 'h';
+    if (is_order)
+        order = stoi(line.substr(2));
+    else
+    {
+        std::stringstream ss(line);
+        ss >> graph;
+        graph.normalize();
+        ss >> coefficient;
+    }
+    return true;
+}
+
 template <class T>
 size_t KontsevichGraphSeries<T>::precision() const
 {
@@ -216,6 +235,52 @@ KontsevichGraphSeries<T> KontsevichGraphSeries<T>::from_istream(std::istream& is
     return graph_series;
 }
 
+template <class T>
+KontsevichGraphSeries<T> KontsevichGraphSeries<T>::from_file(std::string const& filename, std::function<T(std::string)> const& parser, std::function<bool(KontsevichGraph, size_t)> const& filter, size_t threads)
+{
+    // Same result as from_istream, but graphs are read and normalized in parallel.
+    // The parser and the filter are only called from this thread, in file order (e.g. GiNaC is not thread-safe).
+    MappedFile file(filename);
+    if (threads == 0)
+        threads = hardware_threads();
+    std::vector<MappedFile::Range> ranges = file.chunks(4*threads);
+    std::vector< std::vector<KontsevichGraphSeriesLine> > chunks(ranges.size());
+    parallel_for(ranges.size(), threads, [&ranges, &chunks](size_t chunk) {
+        for_each_line(ranges[chunk], [&chunks, chunk](std::string const& line) {
+            KontsevichGraphSeriesLine parsed;
+            if (parsed.parse(line))
+                chunks[chunk].push_back(parsed);
+        });
+    });
+
+    KontsevichGraphSeries<T> graph_series;
+    KontsevichGraphSum<T> term;
+    size_t order = 0;
+    for (auto& chunk : chunks)
+    {
+        for (KontsevichGraphSeriesLine& line : chunk)
+        {
+            if (line.is_order)
+            {
+                graph_series[order] += term;
+                term = KontsevichGraphSum<T>({ });
+                order = line.order;
+            }
+            else
+            {
+                if (filter && !filter(line.graph, order))
+                    continue;
+                T coefficient = parser(line.coefficient);
+                term.push_back({ coefficient, line.graph });
+            }
+        }
+        std::vector<KontsevichGraphSeriesLine>().swap(chunk);
+    }
+    graph_series[order] += term; // the last one
+    graph_series.precision(order);
+    return graph_series;
+}
+
 template <class T>
 std::ostream& operator<<(std::ostream& os, const KontsevichGraphSeries<T>& series)
 {
@@ -4,6 +4,7 @@
 #include <vector>
 #include <utility>
 #include <iostream>
+#include <map>
 #include "kontsevich_graph.hpp"
 
 template<class T> class KontsevichGraphSum;
@@ -39,6 +40,28 @@ class KontsevichGraphSum : public std::vector< std::pair<T, KontsevichGraph> >
     friend std::istream& operator>> <>(std::istream& is, KontsevichGraphSum<T>& sum);
 };
 
+// Incremental version of KontsevichGraphSum<T>::reduce_mod_skew: terms can be added one at a time,
+// and sum() is the same as reducing the concatenation of everything added so far.
+template<class T>
+class KontsevichGraphSumAccumulator
+{
+    KontsevichGraphSum<T> d_terms;
+    std::map< std::pair< size_t, std::vector<KontsevichGraph::VertexPair> >, size_t > d_index;
+    std::vector<size_t> d_changed; // indices of the terms added or changed since the last take_changed()
+    std::vector<bool> d_is_changed;
+
+    void mark_changed(size_t index);
+
+    public:
+    void add(const typename KontsevichGraphSum<T>::Term& term);
+    KontsevichGraphSumAccumulator<T>& operator+=(const KontsevichGraphSum<T>& rhs);
+    KontsevichGraphSumAccumulator<T>& operator-=(const KontsevichGraphSum<T>& rhs);
+    size_t size() const;
+    KontsevichGraphSum<T> const& terms() const; // one term per distinct graph, in order of appearance (including those that cancelled)
+    KontsevichGraphSum<T> sum() const;
+    std::vector<size_t> take_changed(); // indices of the terms added or changed since the last call (including those that cancelled), sorted
+};
+
 template <class T>
 KontsevichGraphSum<T> operator+(KontsevichGraphSum<T> lhs, const KontsevichGraphSum<T>& rhs);
 template <class T>
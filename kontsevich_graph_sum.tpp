@@ -36,6 +36,89 @@ void KontsevichGraphSum<T>::reduce_mod_skew()
     }
 }
 
+template <class T>
+void KontsevichGraphSumAccumulator<T>::mark_changed(size_t index)
+{
+    if (d_is_changed.size() <= index)
+        d_is_changed.resize(index + 1);
+    if (!d_is_changed[index])
+    {
+        d_is_changed[index] = true;
+        d_changed.push_back(index);
+    }
+}
+
+template <class T>
+void KontsevichGraphSumAccumulator<T>::add(const typename KontsevichGraphSum<T>::Term& term)
+{
+    if (term.second.sign() == 0)
+        return;
+    auto position = d_index.find(term.second.abs());
+    if (position == d_index.end())
+    {
+        d_index[term.second.abs()] = d_terms.size();
+        d_terms.push_back(term);
+        d_terms.back().first *= term.second.sign();
+        d_terms.back().second.sign(1);
+        mark_changed(d_terms.size() - 1);
+    }
+    else
+    {
+        d_terms.at(position->second).first += term.first * term.second.sign();
+        mark_changed(position->second);
+    }
+}
+
+template <class T>
+KontsevichGraphSumAccumulator<T>& KontsevichGraphSumAccumulator<T>::operator+=(const KontsevichGraphSum<T>& rhs)
+{
+    for (auto& term : rhs)
+        add(term);
+    return *this;
+}
+
+template <class T>
+KontsevichGraphSumAccumulator<T>& KontsevichGraphSumAccumulator<T>::operator-=(const KontsevichGraphSum<T>& rhs)
+{
+    for (auto& term : rhs)
+        add({ -term.first, term.second });
+    return *this;
+}
+
+template <class T>
+size_t KontsevichGraphSumAccumulator<T>::size() const
+{
+    return d_terms.size();
+}
+
+template <class T>
+KontsevichGraphSum<T> const& KontsevichGraphSumAccumulator<T>::terms() const
+{
+    return d_terms;
+}
+
+template <class T>
+KontsevichGraphSum<T> KontsevichGraphSumAccumulator<T>::sum() const
+{
+    KontsevichGraphSum<T> result;
+    result.reserve(d_terms.size());
+    for (auto& term : d_terms)
+        if (term.first != 0)
+            result.push_back(term);
+    return result;
+}
+
+template <class T>
+std::vector<size_t> KontsevichGraphSumAccumulator<T>::take_changed()
+{
+    std::vector<size_t> changed;
+    changed.swap(d_changed);
+    for (size_t index : changed)
+        d_is_changed[index] = false;
+    std::sort(changed.begin(), changed.end());
+    return changed;
+}
+
 template <class T>
 std::ostream& operator<<(std::ostream& os, const std::pair<T, KontsevichGraph>& term)
 {
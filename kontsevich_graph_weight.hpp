@@ -3,6 +3,7 @@
 
 #include <ginac/ginac.h>
 #include "kontsevich_graph.hpp"
+#include "kontsevich_graph_weight_evaluator.hpp" // for gauss_map_determinant
 #include <vector>
 #include <string>
 
@@ -58,7 +59,13 @@ GiNaC::matrix gauss_map_jacobian(KontsevichGraph graph)
 
 GiNaC::ex weight_integrand(KontsevichGraph graph)
 {
-    return gauss_map_jacobian(graph).determinant(); // TODO: too slow
+    // for numerical values, see WeightIntegrandEvaluator
+    GiNaC::matrix J = gauss_map_jacobian(graph);
+    std::vector<GiNaC::ex> entries;
+    for (size_t i = 0; i != J.rows(); ++i)
+        for (size_t j = 0; j != J.cols(); ++j)
+            entries.push_back(J(i, j));
+    return gauss_map_determinant(graph, entries);
 }
 
 #endif
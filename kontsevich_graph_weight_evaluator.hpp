@@ -0,0 +1,343 @@
+#ifndef INCLUDED_KONTSEVICH_GRAPH_WEIGHT_EVALUATOR_
+#define INCLUDED_KONTSEVICH_GRAPH_WEIGHT_EVALUATOR_
+
+#include "kontsevich_graph.hpp"
+#include "util/sobol_sequence.hpp"
+#include "util/parallel.hpp"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Numerical evaluation (in T = double or long double) of the weight integrand of a graph: the determinant of the Jacobian of the Gauss map,
+// as in gauss_map_jacobian and weight_integrand (kontsevich_graph_weight.hpp), without GiNaC.
+// A point consists of the coordinates x, y of each internal vertex in turn (in the upper half plane); ground vertex j is at (j, 0).
+// The Jacobian is computed analytically, and its determinant by LU decomposition with partial pivoting. Points are processed in batches,
+// with the entries of the matrices of a batch stored next to each other, so that the arithmetic runs over the points of the batch.
+template<class T>
+class WeightIntegrandEvaluator
+{
+    static const size_t batch = 32;
+
+    size_t d_external;
+    size_t d_dimension; // 2 * number of internal vertices
+    std::vector<KontsevichGraph::VertexPair> d_targets;
+    std::vector<T> d_matrices; // entry (i, j) of the matrix of point p of the batch in [(i * d_dimension + j) * batch + p]
+    std::vector<T> d_scale;
+
+    T& entry(size_t i, size_t j, size_t p) { return d_matrices[(i * d_dimension + j) * batch + p]; }
+
+    // The Jacobians at the (at most batch) points
+    void jacobians(size_t lanes, T const* points)
+    {
+        std::fill(d_matrices.begin(), d_matrices.end(), T(0));
+        for (size_t k = 0; k != d_dimension / 2; ++k)
+            for (size_t side = 0; side != 2; ++side)
+            {
+                size_t row = 2*k + side;
+                size_t target = side == 0 ? d_targets[k].first : d_targets[k].second;
+                bool internal_target = target >= d_external;
+                size_t m = internal_target ? target - d_external : 0;
+                for (size_t p = 0; p != lanes; ++p)
+                {
+                    T const* point = points + p * d_dimension;
+                    T a = point[2*k], b = point[2*k + 1];
+                    T x = internal_target ? point[2*m] : T(target), y = internal_target ? point[2*m + 1] : T(0);
+                    // The angle is atan(N/D), with N = 2 b (a - x) and D = (a - x)^2 + y^2 - b^2; its derivative is (D dN - N dD)/(D^2 + N^2)
+                    T u = a - x, N = 2*b*u, D = u*u + y*y - b*b, S = D*D + N*N;
+                    T d_a = (2*b*D - 2*u*N) / S, d_b = (2*u*D + 2*b*N) / S, d_y = -2*y*N / S;
+                    entry(row, 2*k, p) += d_a;
+                    entry(row, 2*k + 1, p) += d_b;
+                    if (internal_target)
+                    {
+                        entry(row, 2*m, p) -= d_a; // the derivative by x is -d_a
+                        entry(row, 2*m + 1, p) += d_y;
+                    }
+                }
+            }
+    }
+
+    // The determinants of the matrices of the batch (which are overwritten)
+    void determinants(size_t lanes, T* values)
+    {
+        size_t n = d_dimension;
+        for (size_t p = 0; p != lanes; ++p)
+            values[p] = 1;
+        for (size_t k = 0; k != n; ++k)
+        {
+            for (size_t p = 0; p != lanes; ++p)
+            {
+                size_t pivot = k;
+                for (size_t i = k + 1; i != n; ++i)
+                    if (std::abs(entry(i, k, p)) > std::abs(entry(pivot, k, p)))
+                        pivot = i;
+                if (pivot != k)
+                {
+                    for (size_t j = k; j != n; ++j)
+                        std::swap(entry(k, j, p), entry(pivot, j, p));
+                    values[p] = -values[p];
+                }
+                T diagonal = entry(k, k, p);
+                values[p] *= diagonal;
+                d_scale[p] = (diagonal != 0) ? 1 / diagonal : 0;
+            }
+            for (size_t i = k + 1; i != n; ++i)
+            {
+                T* row = &entry(i, 0, 0);
+                T const* pivot_row = &entry(k, 0, 0);
+                T factor[batch];
+                for (size_t p = 0; p != lanes; ++p)
+                    factor[p] = row[k * batch + p] * d_scale[p];
+                for (size_t j = k + 1; j != n; ++j)
+                    for (size_t p = 0; p != lanes; ++p)
+                        row[j * batch + p] -= factor[p] * pivot_row[j * batch + p];
+            }
+        }
+    }
+
+    public:
+    explicit WeightIntegrandEvaluator(KontsevichGraph const& graph)
+    : d_external(graph.external()), d_dimension(2 * graph.internal()), d_targets(graph.targets()),
+      d_matrices(d_dimension * d_dimension * batch), d_scale(batch)
+    {}
+
+    size_t dimension() const { return d_dimension; } // the number of coordinates of a point
+
+    // Writes the values at count points, given by dimension() consecutive coordinates each, to values
+    void evaluate(size_t count, T const* points, T* values)
+    {
+        if (d_dimension == 0)
+        {
+            std::fill(values, values + count, T(1));
+            return;
+        }
+        for (size_t first = 0; first < count; first += batch)
+        {
+            size_t lanes = std::min(batch, count - first);
+            jacobians(lanes, points + first * d_dimension);
+            determinants(lanes, values + first);
+        }
+    }
+
+    T operator()(std::vector<T> const& point)
+    {
+        T value;
+        evaluate(1, point.data(), &value);
+        return value;
+    }
+
+    // The Jacobian at the point, row by row (e.g. to compare with gauss_map_jacobian)
+    std::vector<T> jacobian(std::vector<T> const& point)
+    {
+        jacobians(1, point.data());
+        std::vector<T> result;
+        for (size_t i = 0; i != d_dimension; ++i)
+            for (size_t j = 0; j != d_dimension; ++j)
+                result.push_back(entry(i, j, 0));
+        return result;
+    }
+};
+
+// The determinant of the Jacobian of the Gauss map of the graph, with entries of type T (numbers or expressions), given row by row
+// (as by gauss_map_jacobian or WeightIntegrandEvaluator::jacobian). Row pair k (the angles at internal vertex k) only has nonzero entries
+// in the column pairs of vertex k and of its internal targets, so the determinant is expanded (Laplace) along row pairs, taking the
+// 2x2 minors in those columns only. The remaining determinant only depends on the set of columns used so far, so it is memoized;
+// the vertices are ordered such that the columns touched by the row pairs expanded so far grow slowly, which keeps these sets few.
+// Throws std::length_error if the graph has more than 32 internal vertices.
+template<class T>
+class GaussMapDeterminant
+{
+    size_t d_dimension;
+    std::vector<T> const& d_jacobian;
+    std::vector<size_t> d_order;               // vertices in the order of expansion
+    std::vector< std::vector<size_t> > d_columns; // the structurally nonzero columns of each row pair
+    std::unordered_map<uint64_t, T> d_minors;  // used columns -> determinant of the remaining rows and columns
+
+    T const& entry(size_t i, size_t j) const { return d_jacobian[i * d_dimension + j]; }
+
+    T expand(size_t step, uint64_t used)
+    {
+        if (step == d_order.size())
+            return T(1);
+        auto known = d_minors.find(used);
+        if (known != d_minors.end())
+            return known->second;
+        size_t k = d_order[step];
+        std::vector<size_t> const& columns = d_columns[k];
+        T result = T(0);
+        for (size_t first = 0; first != columns.size(); ++first)
+        {
+            size_t c1 = columns[first];
+            if ((used >> c1) & 1)
+                continue;
+            for (size_t second = first + 1; second != columns.size(); ++second)
+            {
+                size_t c2 = columns[second];
+                if ((used >> c2) & 1)
+                    continue;
+                // the rows of vertex k come first, after permuting row pairs (an even permutation); the sign is that of the
+                // positions of c1 and c2 among the unused columns
+                size_t positions = 0;
+                for (size_t c = 0; c != c2; ++c)
+                    if (!((used >> c) & 1))
+                        positions += (c < c1) ? 2 : 1;
+                T minor = entry(2*k, c1) * entry(2*k + 1, c2) - entry(2*k, c2) * entry(2*k + 1, c1);
+                T rest = expand(step + 1, used | (uint64_t(1) << c1) | (uint64_t(1) << c2));
+                if (positions % 2 == 0)
+                    result = result - minor * rest;
+                else
+                    result = result + minor * rest;
+            }
+        }
+        return d_minors.insert({ used, result }).first->second;
+    }
+
+    public:
+    GaussMapDeterminant(KontsevichGraph const& graph, std::vector<T> const& jacobian)
+    : d_dimension(2 * graph.internal()), d_jacobian(jacobian), d_columns(graph.internal())
+    {
+        size_t n = graph.internal(), external = graph.external();
+        if (n > 32)
+            throw std::length_error("GaussMapDeterminant: too many internal vertices");
+        std::vector<uint64_t> touched(n); // column pairs, as bits
+        std::vector<KontsevichGraph::VertexPair> targets = graph.targets();
+        for (size_t k = 0; k != n; ++k)
+        {
+            touched[k] = uint64_t(1) << k;
+            for (size_t target : { targets[k].first, targets[k].second })
+                if (target >= external)
+                    touched[k] |= uint64_t(1) << (target - external);
+            for (size_t m = 0; m != n; ++m)
+                if ((touched[k] >> m) & 1)
+                {
+                    d_columns[k].push_back(2*m);
+                    d_columns[k].push_back(2*m + 1);
+                }
+        }
+        uint64_t union_touched = 0;
+        std::vector<bool> done(n);
+        for (size_t step = 0; step != n; ++step)
+        {
+            size_t best = n, best_count = 0;
+            for (size_t k = 0; k != n; ++k)
+            {
+                if (done[k])
+                    continue;
+                size_t count = 0;
+                for (uint64_t added = touched[k] & ~union_touched; added != 0; added &= added - 1)
+                    ++count;
+                if (best == n || count < best_count)
+                {
+                    best = k;
+                    best_count = count;
+                }
+            }
+            done[best] = true;
+            union_touched |= touched[best];
+            d_order.push_back(best);
+        }
+    }
+
+    T determinant()
+    {
+        return expand(0, 0);
+    }
+};
+
+template<class T>
+T gauss_map_determinant(KontsevichGraph const& graph, std::vector<T> const& jacobian)
+{
+    return GaussMapDeterminant<T>(graph, jacobian).determinant();
+}
+
+struct WeightIntegrationOptions
+{
+    size_t points = 1 << 20; // per shift
+    size_t shifts = 16;      // independent randomizations, for the error estimate
+    size_t threads = 0;      // 0 means one per core
+    uint64_t seed = 0;
+};
+
+struct WeightEstimate
+{
+    double value;
+    double error; // the standard error of the mean over the shifts
+};
+
+// The Kontsevich weight of the graph, sign/(2 pi)^(2n) times the integral of its weight integrand over configurations of its
+// n internal vertices in the upper half plane (with the ground vertices at 0 and 1), by randomized quasi-Monte Carlo:
+// a Sobol sequence with random digital shifts, in coordinates u, v in (0, 1) of each vertex. A vertex p is given by the angles t0 = arg(p) and
+// t1 = arg(p - 1) in the triangle 0 < t0 < t1 < pi, with s = t1 - t0 = pi v and t0 = (pi - s) u: this blows up the ground vertices and
+// infinity, where the integrand is singular in Cartesian coordinates (an angle to a ground vertex is 2 t0 or 2 t1, so e.g. the integrand of
+// the wedge graph becomes constant). Singularities at collisions of internal vertices remain.
+// Throws std::invalid_argument if there are too many internal vertices for the Sobol sequence.
+template<class T = double>
+WeightEstimate integrate_weight(KontsevichGraph const& graph, WeightIntegrationOptions const& options = WeightIntegrationOptions())
+{
+    if (graph.sign() == 0)
+        return { 0, 0 };
+    size_t n = graph.internal();
+    if (n == 0)
+        return { (double)graph.sign(), 0 };
+    SobolSequence sequence(2*n);
+    size_t shifts = std::max(options.shifts, (size_t)1);
+    std::mt19937_64 generator(options.seed);
+    std::vector< std::vector<uint32_t> > shift_words(shifts, std::vector<uint32_t>(2*n));
+    for (auto& words : shift_words)
+        for (uint32_t& word : words)
+            word = generator() >> 32;
+
+    const size_t chunk_size = 4096;
+    size_t chunks_per_shift = (options.points + chunk_size - 1) / chunk_size;
+    std::vector<long double> sums(shifts * chunks_per_shift);
+    parallel_for(sums.size(), options.threads, [&](size_t chunk) {
+        size_t shift = chunk / chunks_per_shift;
+        size_t first = (chunk % chunks_per_shift) * chunk_size;
+        size_t count = std::min(chunk_size, options.points - first);
+        std::vector<T> points(count * 2*n), values(count);
+        sequence.generate(first, count, shift_words[shift].data(), points.data());
+        std::vector<T> jacobians(count, T(1)); // of the change of variables, up to the constant pi^(2n)
+        for (size_t k = 0; k != count; ++k)
+            for (size_t c = 0; c != 2*n; c += 2)
+            {
+                T& x = points[k * 2*n + c];
+                T& y = points[k * 2*n + c + 1];
+                T v = y, s = T(M_PI) * v, t0 = (T(M_PI) - s) * x, t1 = t0 + s;
+                T r0 = std::sin(t1) / std::sin(s); // |p|, by the law of sines in the triangle 0, 1, p
+                x = r0 * std::cos(t0);
+                y = r0 * std::sin(t0);
+                // dx dy = |p|^2 |p - 1|^2 / y dt0 dt1 = sin(t0) sin(t1) / sin(s)^3 dt0 dt1, and dt0 dt1 = pi^2 (1 - v) du dv
+                jacobians[k] *= std::sin(t0) * std::sin(t1) * (1 - v) / std::pow(std::sin(s), 3);
+            }
+        WeightIntegrandEvaluator<T> evaluator(graph);
+        evaluator.evaluate(count, points.data(), values.data());
+        long double sum = 0;
+        for (size_t k = 0; k != count; ++k)
+            if (std::isfinite(values[k] * jacobians[k])) // e.g. overflowing near infinity
+                sum += values[k] * jacobians[k];
+        sums[chunk] = sum;
+    });
+
+    // pi^(2n) / (2 pi)^(2n) = 1 / 4^n
+    long double normalization = graph.sign() / (std::pow(4.0L, (long double)n) * options.points);
+    std::vector<long double> means(shifts);
+    long double mean = 0;
+    for (size_t shift = 0; shift != shifts; ++shift)
+    {
+        for (size_t chunk = 0; chunk != chunks_per_shift; ++chunk)
+            means[shift] += sums[shift * chunks_per_shift + chunk];
+        means[shift] *= normalization;
+        mean += means[shift] / shifts;
+    }
+    long double variance = 0;
+    for (long double value : means)
+        variance += (value - mean) * (value - mean);
+    variance = shifts > 1 ? variance / (shifts - 1) : 0;
+    return { (double)mean, (double)std::sqrt(variance / shifts) };
+}
+
+#endif
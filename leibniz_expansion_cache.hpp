@@ -0,0 +1,43 @@
+#ifndef INCLUDED_LEIBNIZ_EXPANSION_CACHE_H_
+#define INCLUDED_LEIBNIZ_EXPANSION_CACHE_H_
+
+#include "leibniz_graph.hpp"
+#include <unordered_map>
+#include <vector>
+#include <map>
+#include <string>
+
+// Memoized expansions of (normalized) Leibniz graphs.
+// Only the expansion with prefactor 1 and sign 1 is stored (with integer coefficients); other prefactors and signs are applied on lookup.
+// The methods are not thread-safe, but expand() computes missing expansions on several threads.
+template<class T>
+class LeibnizExpansionCache
+{
+    std::unordered_map< LeibnizGraph<T>, KontsevichGraphSum<int> > d_expansions;
+
+    public:
+    size_t size() const;
+    void clear();
+
+    // Make sure the expansions of these graphs are cached, computing the missing ones using `threads` threads (0 means one per core)
+    void expand(std::vector< LeibnizGraph<T> > const& graphs, size_t threads = 0);
+
+    // Same as graph.expansion(prefactor)
+    KontsevichGraphSum<T> expansion(LeibnizGraph<T> const& graph, T prefactor = 1);
+
+    // Sum of coefficient * expansion over the map, reduced mod skew
+    KontsevichGraphSum<T> expansion(std::map< LeibnizGraph<T>, T > const& graphs, size_t threads = 0);
+
+    // Text format: for each graph a line "L <skew> <encoding>", followed by the terms of its expansion, one per line.
+    // load() adds to the cache and returns false if the file cannot be read.
+    bool load(std::string const& filename);
+    bool save(std::string const& filename) const;
+
+    private:
+    static LeibnizGraph<T> key(LeibnizGraph<T> graph);
+    KontsevichGraphSum<int> const& unit_expansion(LeibnizGraph<T> const& graph);
+};
+
+#include "leibniz_expansion_cache.tpp"
+
+#endif
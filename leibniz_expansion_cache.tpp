@@ -0,0 +1,130 @@
+#include "leibniz_expansion_cache.hpp"
+#include "kontsevich_graph_sum.hpp"
+#include "util/parallel.hpp"
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+template<class T>
+size_t LeibnizExpansionCache<T>::size() const
+{
+    return d_expansions.size();
+}
+
+template<class T>
+void LeibnizExpansionCache<T>::clear()
+{
+    d_expansions.clear();
+}
+
+template<class T>
+LeibnizGraph<T> LeibnizExpansionCache<T>::key(LeibnizGraph<T> graph)
+{
+    // The expansion is linear in the sign
+    graph.sign(1);
+    return graph;
+}
+
+template<class T>
+KontsevichGraphSum<int> const& LeibnizExpansionCache<T>::unit_expansion(LeibnizGraph<T> const& graph)
+{
+    LeibnizGraph<T> unsigned_graph = key(graph);
+    auto position = d_expansions.find(unsigned_graph);
+    if (position == d_expansions.end())
+        position = d_expansions.insert({ unsigned_graph, unsigned_graph.unit_expansion() }).first;
+    return position->second;
+}
+
+template<class T>
+void LeibnizExpansionCache<T>::expand(std::vector< LeibnizGraph<T> > const& graphs, size_t threads)
+{
+    std::vector< LeibnizGraph<T> > missing;
+    std::unordered_set< LeibnizGraph<T> > seen;
+    for (auto& graph : graphs)
+    {
+        LeibnizGraph<T> unsigned_graph = key(graph);
+        if (d_expansions.find(unsigned_graph) == d_expansions.end() && seen.insert(unsigned_graph).second)
+            missing.push_back(unsigned_graph);
+    }
+    std::vector< KontsevichGraphSum<int> > expansions(missing.size());
+    parallel_for(missing.size(), threads, [&missing, &expansions](size_t idx) {
+        expansions[idx] = missing[idx].unit_expansion();
+    });
+    for (size_t idx = 0; idx != missing.size(); ++idx)
+        d_expansions[missing[idx]] = std::move(expansions[idx]);
+}
+
+template<class T>
+KontsevichGraphSum<T> LeibnizExpansionCache<T>::expansion(LeibnizGraph<T> const& graph, T prefactor)
+{
+    KontsevichGraphSum<T> graph_sum;
+    prefactor *= graph.sign();
+    for (auto& term : unit_expansion(graph))
+    {
+        T coefficient = prefactor * term.first;
+        if (coefficient != 0)
+            graph_sum.push_back({ coefficient, term.second });
+    }
+    return graph_sum;
+}
+
+template<class T>
+KontsevichGraphSum<T> LeibnizExpansionCache<T>::expansion(std::map< LeibnizGraph<T>, T > const& graphs, size_t threads)
+{
+    std::vector< LeibnizGraph<T> > keys;
+    keys.reserve(graphs.size());
+    for (auto& entry : graphs)
+        keys.push_back(entry.first);
+    expand(keys, threads);
+    KontsevichGraphSumAccumulator<T> total;
+    for (auto& entry : graphs)
+        total += expansion(entry.first, entry.second);
+    return total.sum();
+}
+
+template<class T>
+bool LeibnizExpansionCache<T>::load(std::string const& filename)
+{
+    std::ifstream file(filename);
+    if (!file)
+        return false;
+    KontsevichGraphSum<int>* expansion = nullptr;
+    for (std::string line; getline(file, line); )
+    {
+        if (line.length() == 0 || line[0] == '#') // also skip comments
+            continue;
+        std::stringstream ss(line);
+        if (line[0] == 'L')
+        {
+            std::string marker;
+            bool skew;
+            LeibnizGraph<T> graph;
+            ss >> marker >> skew >> graph;
+            graph.skew(skew);
+            expansion = &d_expansions[key(graph)];
+            expansion->clear();
+        }
+        else if (expansion != nullptr)
+        {
+            KontsevichGraphSum<int>::Term term;
+            ss >> term.second >> term.first;
+            expansion->push_back(term);
+        }
+    }
+    return true;
+}
+
+template<class T>
+bool LeibnizExpansionCache<T>::save(std::string const& filename) const
+{
+    std::ofstream file(filename);
+    if (!file)
+        return false;
+    for (auto& entry : d_expansions)
+    {
+        file << "L " << entry.first.skew() << " " << entry.first.encoding() << "\n";
+        for (auto& term : entry.second)
+            file << term.second.encoding() << "    " << term.first << "\n";
+    }
+    return file.good();
+}
@@ -3,45 +3,75 @@
 
 #include "kontsevich_graph.hpp"
 #include "kontsevich_graph_sum.hpp"
+#include "util/hash_combine.hpp"
 #include <vector>
 #include <string>
 #include <map>
 #include <set>
+#include <array>
 #include <istream>
+#include <functional>
 
 template<class T> class LeibnizGraph;
 template<class T> std::istream& operator>>(std::istream& is, LeibnizGraph<T>& g);
+namespace std { template<class T> struct hash< LeibnizGraph<T> >; }
 
+// Targets are referred to by slot: slot 2*i is d_targets[i].first, slot 2*i + 1 is d_targets[i].second.
+// Since no pointers are stored, copies are plain member-wise copies.
 template<class T>
 class LeibnizGraph : KontsevichGraph
 {
     std::vector<KontsevichGraph::VertexPair> d_jacobiators;
-    bool d_skew;
-    size_t d_max_jac_indegree;
-    std::vector< std::set<KontsevichGraph::Vertex*> > d_jacobiator_targets;
-    std::map<KontsevichGraph::Vertex*, size_t> d_leibniz_targets;
+    bool d_skew = false;
+    size_t d_max_jac_indegree = 0;
+    std::vector< std::array<size_t, 3> > d_jacobiator_targets;    // sorted slots of the three Jacobiator arguments
+    std::vector< std::pair<size_t, size_t> > d_leibniz_targets;   // (slot, Jacobiator) for edges landing on a Jacobiator, sorted by slot
 
 public:
     using KontsevichGraph::sign;
     LeibnizGraph() {};
     LeibnizGraph(KontsevichGraph graph, std::vector<KontsevichGraph::VertexPair> jacobiators, bool skew = false);
-    LeibnizGraph(const LeibnizGraph<T>& other);
-    LeibnizGraph& operator=(const LeibnizGraph<T>& other);
     bool skew() const;
     bool skew(bool new_skew);
     std::string encoding() const;
     static std::map< LeibnizGraph<T>, T> map_from_istream(std::istream& is, std::function<T(std::string)> const& parser = nullptr);
+    static std::map< LeibnizGraph<T>, T> map_from_file(std::string const& filename, std::function<T(std::string)> const& parser = nullptr, size_t threads = 0);
     static std::set< LeibnizGraph<T> > those_yielding_kontsevich_graph(KontsevichGraph& graph, bool skew_leibniz = false);
     size_t max_jac_indegree() const;
     bool operator<(const LeibnizGraph<T>& rhs) const;
-    KontsevichGraphSum<T> expansion(T prefactor = 1);
+    bool operator==(const LeibnizGraph<T>& rhs) const;
+    KontsevichGraphSum<T> expansion(T prefactor = 1) const;
+    KontsevichGraphSum<int> unit_expansion() const; // expansion with prefactor 1, without touching T (safe to call from several threads)
     void normalize();
 
 private:
+    KontsevichGraph::Vertex& target_in_slot(size_t slot);
+    template<class S> KontsevichGraphSum<S> expansion_with_prefactor(S prefactor) const;
     void set_jacobiator_and_leibniz_targets();
     friend std::istream& operator>> <>(std::istream& is, LeibnizGraph<T>& g);
+    friend struct std::hash< LeibnizGraph<T> >;
 };
 
+namespace std
+{
+    template<class T>
+    struct hash< LeibnizGraph<T> >
+    {
+        size_t operator()(const LeibnizGraph<T>& g) const
+        {
+            size_t seed = g.d_skew;
+            hash_combine(seed, g.d_external);
+            hash_combine(seed, g.d_internal);
+            for (auto& target_pair : g.d_targets)
+                hash_combine(seed, ((size_t)(unsigned char)target_pair.first << 8) | (unsigned char)target_pair.second);
+            for (auto& jacobiator : g.d_jacobiators)
+                hash_combine(seed, ((size_t)(unsigned char)jacobiator.first << 8) | (unsigned char)jacobiator.second);
+            hash_combine(seed, (size_t)g.d_sign);
+            return seed;
+        }
+    };
+}
+
 #include "leibniz_graph.tpp"
 
 #endif
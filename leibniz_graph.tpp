@@ -1,8 +1,12 @@
 #include "leibniz_graph.hpp"
 #include "util/cartesian_product.hpp"
 #include "util/permutations.hpp"
+#include "util/mapped_file.hpp"
+#include "util/parallel.hpp"
 #include <sstream>
 #include <tuple>
+#include <algorithm>
+#include <numeric>
 
 template<class T>
 LeibnizGraph<T>::LeibnizGraph(KontsevichGraph graph, std::vector<KontsevichGraph::VertexPair> jacobiators, bool skew)
@@ -12,20 +16,9 @@ LeibnizGraph<T>::LeibnizGraph(KontsevichGraph graph, std::vector<KontsevichGraph
 }
 
 template<class T>
-LeibnizGraph<T>::LeibnizGraph(const LeibnizGraph<T>& other)
-: KontsevichGraph(other), d_jacobiators(other.d_jacobiators), d_skew(other.d_skew)
+KontsevichGraph::Vertex& LeibnizGraph<T>::target_in_slot(size_t slot)
 {
-    set_jacobiator_and_leibniz_targets();
-}
-
-template<class T>
-LeibnizGraph<T>& LeibnizGraph<T>::operator=(const LeibnizGraph<T>& other)
-{
-    KontsevichGraph::operator=(other);
-    d_jacobiators = other.d_jacobiators;
-    d_skew = other.d_skew;
-    set_jacobiator_and_leibniz_targets();
-    return *this;
+    return slot % 2 == 0 ? d_targets[slot / 2].first : d_targets[slot / 2].second;
 }
 
 template<class T>
@@ -38,22 +31,16 @@ void LeibnizGraph<T>::set_jacobiator_and_leibniz_targets()
         which_jacobiator[d_jacobiators[j].second] = j;
     }
 
-    // Start building the sets of references to Leibniz targets (incoming edges on Jacobiator vertices)
+    // Start building the list of Leibniz target slots (incoming edges on Jacobiator vertices)
     d_leibniz_targets.clear();
     std::map<size_t, size_t> jac_indegree;
-    for (KontsevichGraph::VertexPair& target_pair : d_targets)
+    for (size_t slot = 0; slot != 2*d_targets.size(); ++slot)
     {
-        auto it1 = which_jacobiator.find(target_pair.first);
-        if (it1 != which_jacobiator.end())
-        {
-            d_leibniz_targets[&target_pair.first] = it1->second;
-            ++jac_indegree[it1->second];
-        }
-        auto it2 = which_jacobiator.find(target_pair.second);
-        if (it2 != which_jacobiator.end())
+        auto it = which_jacobiator.find(target_in_slot(slot));
+        if (it != which_jacobiator.end())
         {
-            d_leibniz_targets[&target_pair.second] = it2->second;
-            ++jac_indegree[it2->second];
+            d_leibniz_targets.push_back({ slot, it->second });
+            ++jac_indegree[it->second];
         }
     }
     d_max_jac_indegree = 0;
@@ -61,7 +48,7 @@ void LeibnizGraph<T>::set_jacobiator_and_leibniz_targets()
         if (indegree.second - 1 > d_max_jac_indegree)
             d_max_jac_indegree = indegree.second - 1;
 
-    // Build the sets of three Jacobiator targets each
+    // Build the sorted triples of Jacobiator target slots
     d_jacobiator_targets.clear();
     d_jacobiator_targets.resize(d_jacobiators.size());
     d_max_jac_indegree = 0;
@@ -70,15 +57,22 @@ void LeibnizGraph<T>::set_jacobiator_and_leibniz_targets()
     {
         KontsevichGraph::Vertex v = jacobiator.first;
         KontsevichGraph::Vertex w = jacobiator.second;
-        KontsevichGraph::VertexPair& target_pair_v = d_targets[(size_t)v - d_external];
-        KontsevichGraph::VertexPair& target_pair_w = d_targets[(size_t)w - d_external];
-        KontsevichGraph::Vertex* a = &target_pair_v.first;
-        KontsevichGraph::Vertex* b = &target_pair_v.second;
-        KontsevichGraph::Vertex* c = (target_pair_w.first == v) ? &target_pair_w.second : &target_pair_w.first;
+        size_t slot_v = 2*((size_t)v - d_external);
+        size_t slot_w = 2*((size_t)w - d_external);
+        size_t jacobiator_edge = (d_targets[(size_t)w - d_external].first == v) ? slot_w : slot_w + 1;
+        size_t a = slot_v;
+        size_t b = slot_v + 1;
+        size_t c = (jacobiator_edge == slot_w) ? slot_w + 1 : slot_w;
         // Remove internal Jacobiator edge from Leibniz targets
-        d_leibniz_targets.erase(target_pair_w.first == v ? &target_pair_w.first : &target_pair_w.second);
+        auto position = std::find_if(d_leibniz_targets.begin(), d_leibniz_targets.end(), [jacobiator_edge](const std::pair<size_t, size_t>& leibniz_target) {
+            return leibniz_target.first == jacobiator_edge;
+        });
+        if (position != d_leibniz_targets.end())
+            d_leibniz_targets.erase(position);
         // Set Jacobiator targets
-        d_jacobiator_targets[j++] = { a, b, c };
+        d_jacobiator_targets[j] = { a, b, c };
+        std::sort(d_jacobiator_targets[j].begin(), d_jacobiator_targets[j].end());
+        ++j;
     }
 }
 
@@ -102,6 +96,13 @@ bool LeibnizGraph<T>::operator<(const LeibnizGraph<T>& rhs) const
            std::tie(rhs.d_skew, rhs.d_external, rhs.d_internal, rhs.d_targets, rhs.d_jacobiators, rhs.d_sign);
 }
 
+template<class T>
+bool LeibnizGraph<T>::operator==(const LeibnizGraph<T>& rhs) const
+{
+    return std::tie(this->d_skew, this->d_external, this->d_internal, this->d_targets, this->d_jacobiators, this->d_sign) == \
+           std::tie(rhs.d_skew, rhs.d_external, rhs.d_internal, rhs.d_targets, rhs.d_jacobiators, rhs.d_sign);
+}
+
 template<class T>
 size_t LeibnizGraph<T>::max_jac_indegree() const
 {
@@ -161,6 +162,46 @@ std::map< LeibnizGraph<T>, T> LeibnizGraph<T>::map_from_istream(std::istream& is
     return result;
 }
 
+template<class T>
+std::map< LeibnizGraph<T>, T> LeibnizGraph<T>::map_from_file(std::string const& filename, std::function<T(std::string)> const& parser, size_t threads)
+{
+    // Same result as map_from_istream, but graphs are read and normalized in parallel; the parser is only called from this thread
+    std::map< LeibnizGraph<T>, T> result;
+    if (parser == nullptr)
+        return result;
+    MappedFile file(filename);
+    if (threads == 0)
+        threads = hardware_threads();
+    std::vector<MappedFile::Range> ranges = file.chunks(4*threads);
+    std::vector< std::vector< std::pair<LeibnizGraph<T>, std::string> > > chunks(ranges.size());
+    parallel_for(ranges.size(), threads, [&ranges, &chunks](size_t chunk) {
+        for_each_line(ranges[chunk], [&chunks, chunk](std::string const& line) {
+            if (line.length() == 0 || line[0] == '#') // also skip comments
+                return;
+            std::stringstream ss(line);
+            LeibnizGraph<T> g;
+            ss >> g;
+            g.skew(true); // XXX: temporary
+            g.normalize();
+            std::string coefficient_str;
+            ss >> coefficient_str;
+            chunks[chunk].push_back({ g, coefficient_str });
+        });
+    });
+    for (auto& chunk : chunks)
+    {
+        for (auto& entry : chunk)
+        {
+            T coefficient = parser(entry.second);
+            coefficient *= entry.first.sign();
+            entry.first.sign(1);
+            result[entry.first] += coefficient;
+        }
+        chunk.clear();
+    }
+    return result;
+}
+
 template<class T>
 std::set< LeibnizGraph<T> > LeibnizGraph<T>::those_yielding_kontsevich_graph(KontsevichGraph& graph, bool skew_leibniz)
 {
@@ -192,13 +233,17 @@ std::set< LeibnizGraph<T> > LeibnizGraph<T>::those_yielding_kontsevich_graph(Kon
 template<class T>
 void LeibnizGraph<T>::normalize()
 {
-    // Normal form of Leibniz graph (three permutations of each Jacobiator, take minimal encoding, remember where Jacobiators are)
+    // Normal form of Leibniz graph: the minimum of (targets, Jacobiators, sign) over all cyclic shifts of the Jacobiator arguments,
+    // all permutations of the ground vertices (if skew) and all relabelings of the internal vertices (remembering where the Jacobiators go).
+    // For each choice of shifts and ground permutation, the internal labels are assigned one at a time, and a partial labeling is
+    // abandoned as soon as a lower bound for its targets exceeds the best targets found so far (over all choices).
+    // Ties are broken as in the exhaustive search: the first relabeling in lexicographic order, then the smallest sign.
 
     // TODO: save partial expansion?
 
     // Set Leibniz targets to "bottom" vertex in Jacobiator, i.e. v in { v, w } (the Jacobiator edge is v <-- w)
     for (auto& leibniz_target : d_leibniz_targets)
-        *leibniz_target.first = d_jacobiators[leibniz_target.second].first;
+        target_in_slot(leibniz_target.first) = d_jacobiators[leibniz_target.second].first;
 
     // Fix some ordering of Jacobiator arguments (as a vector, instead of a set)
     std::vector< std::vector<KontsevichGraph::Vertex> > jacobiator_arguments(d_jacobiators.size());
@@ -206,11 +251,86 @@ void LeibnizGraph<T>::normalize()
     {
         jacobiator_arguments[j].resize(3);
         size_t k = 0;
-        for (auto it = d_jacobiator_targets[j].begin(); it != d_jacobiator_targets[j].end(); ++it)
-            jacobiator_arguments[j][k++] = **it;
+        for (size_t slot : d_jacobiator_targets[j])
+            jacobiator_arguments[j][k++] = target_in_slot(slot);
     }
 
-    std::vector< std::tuple< std::vector<KontsevichGraph::VertexPair>, std::vector<KontsevichGraph::VertexPair>, int> > leibniz_graphs;
+    // Best targets and Jacobiators so far, and all labelings attaining them: (choice of shifts and ground permutation, relabeling, sign)
+    bool found = false;
+    std::vector<KontsevichGraph::VertexPair> best_targets, best_jacobiators;
+    std::vector< std::tuple< size_t, std::vector<KontsevichGraph::Vertex>, int > > minimizers;
+
+    std::vector<KontsevichGraph::VertexPair> targets_template;
+    int choice_sign = 1;
+    size_t choice = 0;
+    std::vector<KontsevichGraph::Vertex> labels(d_external + d_internal);    // new label of each vertex
+    std::vector<bool> assigned(d_external + d_internal);
+    std::vector<KontsevichGraph::Vertex> labeled;                            // vertex at each new internal label (so far)
+
+    auto bounded_pair = [&labels, &assigned](KontsevichGraph::VertexPair target_pair, KontsevichGraph::Vertex next_label) {
+        // Lower bound for the relabeled (sorted) target pair: unassigned vertices will get at least the next label
+        KontsevichGraph::Vertex a = assigned[target_pair.first] ? labels[target_pair.first] : next_label;
+        KontsevichGraph::Vertex b = assigned[target_pair.second] ? labels[target_pair.second] : next_label;
+        return a < b ? KontsevichGraph::VertexPair(a, b) : KontsevichGraph::VertexPair(b, a);
+    };
+
+    std::function<void(size_t)> search = [&](size_t depth) {
+        KontsevichGraph::Vertex next_label = d_external + depth;
+        if (found)
+        {
+            for (size_t k = 0; k != depth; ++k)
+            {
+                KontsevichGraph::VertexPair lower_bound = bounded_pair(targets_template[(size_t)labeled[k] - d_external], next_label);
+                if (best_targets[k] < lower_bound)
+                    return;
+                if (lower_bound < best_targets[k])
+                    break;
+            }
+        }
+        if (depth == d_internal)
+        {
+            std::vector<KontsevichGraph::VertexPair> targets(d_internal);
+            for (size_t k = 0; k != d_internal; ++k)
+                targets[k] = { labels[targets_template[(size_t)labeled[k] - d_external].first], labels[targets_template[(size_t)labeled[k] - d_external].second] };
+            size_t exchanges = sort_pairs(targets.begin(), targets.end());
+            std::vector<KontsevichGraph::VertexPair> jacobiators = d_jacobiators;
+            for (KontsevichGraph::VertexPair& jacobiator : jacobiators)
+                jacobiator = { labels[jacobiator.first], labels[jacobiator.second] };
+            auto candidate = std::tie(targets, jacobiators);
+            if (!found || candidate < std::tie(best_targets, best_jacobiators))
+            {
+                found = true;
+                best_targets = targets;
+                best_jacobiators = jacobiators;
+                minimizers.clear();
+            }
+            else if (candidate != std::tie(best_targets, best_jacobiators))
+                return;
+            minimizers.push_back(std::make_tuple(choice, labels, (exchanges % 2 == 0 ? 1 : -1) * choice_sign));
+            return;
+        }
+        // Try the unlabeled vertices in order of (a lower bound for) their relabeled targets
+        std::vector< std::pair<KontsevichGraph::VertexPair, KontsevichGraph::Vertex> > candidates;
+        for (size_t v = d_external; v != d_external + d_internal; ++v)
+        {
+            if (assigned[v])
+                continue;
+            labels[v] = next_label;
+            assigned[v] = true;
+            candidates.push_back({ bounded_pair(targets_template[v - d_external], next_label + 1), v });
+            assigned[v] = false;
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for (auto& candidate : candidates)
+        {
+            labels[candidate.second] = next_label;
+            assigned[candidate.second] = true;
+            labeled.push_back(candidate.second);
+            search(depth + 1);
+            labeled.pop_back();
+            assigned[candidate.second] = false;
+        }
+    };
 
     std::vector<KontsevichGraph::Vertex> ground_vertices(d_external);
     std::iota(ground_vertices.begin(), ground_vertices.end(), 0);
@@ -226,62 +346,74 @@ void LeibnizGraph<T>::normalize()
             for (size_t j = 0; j != d_jacobiators.size(); ++j)
             {
                 size_t k = 0;
-                for (auto it = d_jacobiator_targets[j].begin(); it != d_jacobiator_targets[j].end(); ++it)
-                    **it = jacobiator_arguments[j][(k++ + (*shifts)[j]) % 3];
+                for (size_t slot : d_jacobiator_targets[j])
+                    target_in_slot(slot) = jacobiator_arguments[j][(k++ + (*shifts)[j]) % 3];
             }
 
-            std::vector<KontsevichGraph::VertexPair> d_targets_template = d_targets;
+            targets_template = d_targets;
 
             // Permute ground vertices (if skew)
-            for (KontsevichGraph::VertexPair& target_pair : d_targets_template)
+            for (KontsevichGraph::VertexPair& target_pair : targets_template)
             {
                 if ((size_t)target_pair.first < d_external)
                     target_pair.first = ground_vertices[target_pair.first];
                 if ((size_t)target_pair.second < d_external)
                     target_pair.second = ground_vertices[target_pair.second];
             }
+            choice_sign = d_skew ? parity(ground_vertices) : 1; // skew-symmetrization sign
 
-            // Find permutation of vertex labels such that the list of targets is minimal with respect to the defined ordering
-            // AND the Jacobiators are minimal (needed because there can be automorphisms that move the Jacobiators)
-            std::pair< std::vector<KontsevichGraph::VertexPair>, std::vector<KontsevichGraph::VertexPair> > global_minimum = { d_targets_template, d_jacobiators };
-            size_t exchanges = sort_pairs(global_minimum.first.begin(), global_minimum.first.end());
-
-            std::vector<KontsevichGraph::Vertex> vertices(d_external + d_internal);
-            std::iota(vertices.begin(), vertices.end(), 0);
-
-            while (std::next_permutation(vertices.begin() + d_external, vertices.end()))
-            {
-                std::pair< std::vector<KontsevichGraph::VertexPair>, std::vector<KontsevichGraph::VertexPair> > local_minimum = { d_targets_template, d_jacobiators };
-                size_t local_exchanges = apply_permutation(d_internal, d_external, local_minimum.first, vertices);
-                // Find where Jacobiators are
-                for (KontsevichGraph::VertexPair& new_jacobiator : local_minimum.second)
-                    new_jacobiator = { vertices[(size_t)new_jacobiator.first], vertices[(size_t)new_jacobiator.second] };
-                if (local_minimum < global_minimum)
-                {
-                    global_minimum = local_minimum;
-                    exchanges = local_exchanges;
-                }
-            }
-            int sign = exchanges % 2 == 0 ? 1 : -1;
-            if (d_skew)
-                sign *= parity(ground_vertices); // skew-symmetrization sign
-            leibniz_graphs.push_back(std::make_tuple(global_minimum.first, global_minimum.second, sign));
+            std::iota(labels.begin(), labels.begin() + d_external, 0);
+            std::fill(assigned.begin(), assigned.begin() + d_external, true);
+            search(0);
+            ++choice;
         }
     } while (d_skew && std::next_permutation(ground_vertices.begin(), ground_vertices.end()));
-    auto& leibniz_normal_form = *min_element(leibniz_graphs.begin(), leibniz_graphs.end());
-    d_targets = std::get<0>(leibniz_normal_form);
-    d_jacobiators = std::get<1>(leibniz_normal_form);
-    d_sign *= std::get<2>(leibniz_normal_form);
+
+    // Sign: for each choice attaining the minimum, that of its first relabeling; then the smallest of those
+    int sign = 1;
+    bool first_choice = true;
+    for (size_t m = 0; m != minimizers.size(); )
+    {
+        size_t n = m;
+        auto first_relabeling = m;
+        for (; n != minimizers.size() && std::get<0>(minimizers[n]) == std::get<0>(minimizers[m]); ++n)
+            if (std::get<1>(minimizers[n]) < std::get<1>(minimizers[first_relabeling]))
+                first_relabeling = n;
+        int choice_minimum_sign = std::get<2>(minimizers[first_relabeling]);
+        if (first_choice || choice_minimum_sign < sign)
+            sign = choice_minimum_sign;
+        first_choice = false;
+        m = n;
+    }
+    d_targets = best_targets;
+    d_jacobiators = best_jacobiators;
+    d_sign *= sign;
     set_jacobiator_and_leibniz_targets();
 }
 
 template<class T>
-KontsevichGraphSum<T> LeibnizGraph<T>::expansion(T prefactor)
+KontsevichGraphSum<T> LeibnizGraph<T>::expansion(T prefactor) const
 {
-    // Back-up d_targets:
-    std::vector<KontsevichGraph::VertexPair> d_targets_values = d_targets;
+    return expansion_with_prefactor<T>(prefactor);
+}
 
-    KontsevichGraphSum<T> graph_sum;
+template<class T>
+KontsevichGraphSum<int> LeibnizGraph<T>::unit_expansion() const
+{
+    return expansion_with_prefactor<int>(1);
+}
+
+template<class T>
+template<class S>
+KontsevichGraphSum<S> LeibnizGraph<T>::expansion_with_prefactor(S prefactor) const
+{
+    // Work on a copy of the targets
+    std::vector<KontsevichGraph::VertexPair> targets = d_targets;
+    auto target_in_slot = [&targets](size_t slot) -> KontsevichGraph::Vertex& {
+        return slot % 2 == 0 ? targets[slot / 2].first : targets[slot / 2].second;
+    };
+
+    KontsevichGraphSum<S> graph_sum;
 
     // Fix some ordering of Jacobiator arguments (as a vector, instead of a set)
     std::vector< std::vector<KontsevichGraph::Vertex> > jacobiator_arguments(d_jacobiators.size());
@@ -289,8 +421,8 @@ KontsevichGraphSum<T> LeibnizGraph<T>::expansion(T prefactor)
     {
         jacobiator_arguments[j].resize(3);
         size_t k = 0;
-        for (auto it = d_jacobiator_targets[j].begin(); it != d_jacobiator_targets[j].end(); ++it)
-            jacobiator_arguments[j][k++] = **it;
+        for (size_t slot : d_jacobiator_targets[j])
+            jacobiator_arguments[j][k++] = target_in_slot(slot);
     }
 
     std::vector<size_t> leibniz_sizes(d_leibniz_targets.size(), 2);
@@ -300,7 +432,7 @@ KontsevichGraphSum<T> LeibnizGraph<T>::expansion(T prefactor)
         // Leibniz rule
         size_t idx = 0;
         for (auto& leibniz_target : d_leibniz_targets)
-            *(leibniz_target.first) = (*leibniz_index)[idx++] == 0 ? d_jacobiators[leibniz_target.second].first : d_jacobiators[leibniz_target.second].second;
+            target_in_slot(leibniz_target.first) = (*leibniz_index)[idx++] == 0 ? d_jacobiators[leibniz_target.second].first : d_jacobiators[leibniz_target.second].second;
 
         // Choose shifts (by 0, 1, or 2) in Jacobiator arguments
         std::vector<size_t> shifts_max(d_jacobiators.size(), 3);
@@ -312,12 +444,12 @@ KontsevichGraphSum<T> LeibnizGraph<T>::expansion(T prefactor)
             for (size_t j = 0; j != d_jacobiators.size(); ++j)
             {
                 size_t k = 0;
-                for (auto it = d_jacobiator_targets[j].begin(); it != d_jacobiator_targets[j].end(); ++it)
-                    **it = jacobiator_arguments[j][(k++ + (*shifts)[j]) % 3];
+                for (size_t slot : d_jacobiator_targets[j])
+                    target_in_slot(slot) = jacobiator_arguments[j][(k++ + (*shifts)[j]) % 3];
             }
 
-            KontsevichGraph new_graph(d_internal, d_external, d_targets, d_sign);
-            graph_sum += KontsevichGraphSum<T>({ { prefactor, new_graph } });
+            KontsevichGraph new_graph(d_internal, d_external, targets, d_sign);
+            graph_sum += KontsevichGraphSum<S>({ { prefactor, new_graph } });
         }
     }
 
@@ -326,9 +458,5 @@ KontsevichGraphSum<T> LeibnizGraph<T>::expansion(T prefactor)
 
     graph_sum.reduce_mod_skew();
 
-    // Restore back-up of d_targets:
-    for (size_t j = 0; j != d_internal; ++j)
-        d_targets[j] = d_targets_values[j];
-
     return graph_sum;
 }
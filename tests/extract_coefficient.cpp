@@ -1,7 +1,8 @@
-#include "../kontsevich_graph_series.hpp"
+#include "../kontsevich_graph_pipeline.hpp"
 #include <ginac/ginac.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 using namespace std;
 using namespace GiNaC;
 
@@ -14,31 +15,50 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    // Reading in graph series:
+    // Streaming graph series:
     string graph_series_filename(argv[1]);
     ifstream graph_series_file(graph_series_filename);
     parser coefficient_reader;
-    KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, [&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
+    KontsevichGraphPipeline<ex> pipeline([&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
 
     ex expression = coefficient_reader(string(argv[2]));
 
+    // Symbols are only known once their coefficients have been read, so the substitution grows along the way
     lst allzero_substitution;
-    if (expression == 1)
-        for (auto named_symbol : coefficient_reader.get_syms())
-            allzero_substitution.append(named_symbol.second==0);
-
-    for (size_t n = 0; n <= graph_series.precision(); ++n)
-    {
-        if (graph_series[n] != 0 || n == graph_series.precision())
-            cout << "h^" << n << ":\n";
-        for (auto& term : graph_series[n])
+    size_t substituted_symbols = 0;
+    auto constant_part = [&coefficient_reader, &allzero_substitution, &substituted_symbols](ex coefficient) -> ex {
+        if (coefficient_reader.get_syms().size() != substituted_symbols)
         {
+            allzero_substitution = lst();
+            for (auto named_symbol : coefficient_reader.get_syms())
+                allzero_substitution.append(named_symbol.second==0);
+            substituted_symbols = coefficient_reader.get_syms().size();
+        }
+        return coefficient.subs(allzero_substitution);
+    };
+
+    // The header of an order is printed with its first nonzero term (and always for the last order)
+    bool printed_header = false;
+    pipeline.run(graph_series_file, cout,
+        [&printed_header](size_t, KontsevichGraphPipeline<ex>::Emit const&) {
+            printed_header = false;
+        },
+        [&](size_t n, KontsevichGraphSum<ex>::Term& term, KontsevichGraphPipeline<ex>::Emit const& emit) {
             if (expression == 1)
-                term.first = term.first.subs(allzero_substitution);
+                term.first = constant_part(term.first);
             else
                 term.first = term.first.coeff(expression);
-            if (term.first != 0)
-                cout << term.second.encoding() << "    " << term.first << "\n";
-        }
-    }
+            if (term.first == 0)
+                return;
+            stringstream ss;
+            if (!printed_header)
+                ss << "h^" << n << ":\n";
+            printed_header = true;
+            ss << term.second.encoding() << "    " << term.first << "\n";
+            emit(ss.str());
+        },
+        [&printed_header](size_t n, KontsevichGraphPipeline<ex>::Emit const& emit) {
+            if (!printed_header)
+                emit("h^" + to_string(n) + ":\n");
+        });
 }
@@ -0,0 +1,132 @@
+#include "../kontsevich_graph_series.hpp"
+#include "../kontsevich_graph_weight_evaluator.hpp"
+#include "../util/factorial.hpp"
+#include <ginac/ginac.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <cmath>
+using namespace std;
+using namespace GiNaC;
+
+// Numerical weights of the graphs in a graph series, in the format star_product reads (e.g. data/basic2.txt):
+// the coefficient of each graph is replaced by its estimated weight, followed by a comment with the old coefficient and the error estimate.
+// With --compare, the weights are checked against the coefficients of a star product (e.g. data/star3.txt, or data/star3w.txt with the values
+// of data/weights2.txt substituted): the coefficient of a graph with n internal vertices is its weight * multiplicity / n! (as in star_product).
+
+int main(int argc, char* argv[])
+{
+    WeightIntegrationOptions options;
+    bool long_double = false;
+    string compare_filename, compare_values_filename;
+    bool usage = argc < 2;
+    for (int idx = 2; idx < argc && !usage; ++idx)
+    {
+        string argument = argv[idx];
+        if (argument.substr(0, 9) == "--points=")
+            options.points = stoul(argument.substr(9));
+        else if (argument.substr(0, 9) == "--shifts=")
+            options.shifts = stoul(argument.substr(9));
+        else if (argument.substr(0, 10) == "--threads=")
+            options.threads = stoul(argument.substr(10));
+        else if (argument.substr(0, 7) == "--seed=")
+            options.seed = stoul(argument.substr(7));
+        else if (argument == "--long-double")
+            long_double = true;
+        else if (argument.substr(0, 10) == "--compare=")
+            compare_filename = argument.substr(10);
+        else if (argument.substr(0, 17) == "--compare-values=")
+            compare_values_filename = argument.substr(17);
+        else
+            usage = true;
+    }
+    if (usage || options.points == 0)
+    {
+        cerr << "Usage: " << argv[0] << " <graph-series-filename> [--points=N] [--shifts=R] [--threads=T] [--seed=s] [--long-double]\n"
+             << "       [--compare=<star-product-filename>] [--compare-values=<relations-filename>]\n\n"
+             << "--points=N                the number of Sobol points per shift (default: " << options.points << ").\n"
+             << "--shifts=R                the number of random digital shifts, for the error estimate (default: " << options.shifts << ").\n"
+             << "--threads=T               the number of threads (default: one per core).\n"
+             << "--seed=s                  the seed for the shifts (default: 0).\n"
+             << "--long-double             evaluate the integrand in long double.\n"
+             << "--compare=filename        compare the weights with those implied by the coefficients of the star product in filename,\n"
+             << "                          and report the deviations in units of the error estimate.\n"
+             << "--compare-values=filename substitute the relations in filename (lines name==value, e.g. data/weights2.txt)\n"
+             << "                          in the coefficients of the star product; graphs with non-numeric coefficients are not compared.\n";
+        return 1;
+    }
+
+    // Reading in graph series:
+    string graph_series_filename(argv[1]);
+    ifstream graph_series_file(graph_series_filename);
+    parser coefficient_reader;
+    KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, [&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
+
+    // Reading in the star product to compare with (coefficients of the graphs with sign +1):
+    map< pair< size_t, vector<KontsevichGraph::VertexPair> >, ex > star_product_coefficients;
+    if (compare_filename != "")
+    {
+        parser compare_reader;
+        lst relations;
+        ifstream compare_values_file(compare_values_filename);
+        for (string lhs, rhs; getline(compare_values_file, lhs, '=') && compare_values_file.ignore(1) && getline(compare_values_file, rhs); )
+            relations.append(compare_reader(lhs) == compare_reader(rhs));
+        ifstream compare_file(compare_filename);
+        KontsevichGraphSeries<ex> star_product = KontsevichGraphSeries<ex>::from_istream(compare_file, [&compare_reader](std::string s) -> ex { return compare_reader(s); });
+        for (size_t n = 0; n <= star_product.precision(); ++n)
+            for (auto& term : star_product[n])
+                star_product_coefficients[term.second.abs()] = (term.first * term.second.sign()).subs(relations);
+        if (star_product_coefficients.empty())
+        {
+            cerr << "Found no graphs in " << compare_filename << ".\n";
+            return 1;
+        }
+    }
+    size_t compared = 0;
+    double max_deviation = 0;
+
+    cout << setprecision(10);
+    for (size_t n = 0; n <= graph_series.precision(); ++n)
+    {
+        cout << "h^" << n << ":\n";
+        for (auto& term : graph_series[n])
+        {
+            WeightEstimate weight;
+            try {
+                weight = long_double ? integrate_weight<long double>(term.second, options) : integrate_weight<double>(term.second, options);
+            }
+            catch (std::invalid_argument const& e)
+            {
+                cerr << term.second.encoding() << ": " << e.what() << "\n";
+                return 1;
+            }
+            cout << term.second.encoding() << "    " << weight.value << "\n";
+            cout << "# " << term.first << " ~ " << weight.value << " +- " << weight.error << "\n";
+            auto known = star_product_coefficients.find(term.second.abs());
+            if (known != star_product_coefficients.end())
+            {
+                if (is_a<numeric>(known->second))
+                {
+                    size_t n_factorial = (n == 0) ? 1 : factorial(n);
+                    double expected = ex_to<numeric>(known->second * term.second.sign() * n_factorial / term.second.multiplicity()).to_double();
+                    double deviation;
+                    if (weight.error != 0)
+                        deviation = (weight.value - expected) / weight.error;
+                    else
+                        deviation = (fabs(weight.value - expected) <= 1e-12 * fabs(expected)) ? 0 : INFINITY; // up to rounding
+                    cout << "# expected " << expected << " (star product coefficient " << known->second << "): deviation " << deviation << " sigma\n";
+                    max_deviation = max(max_deviation, fabs(deviation));
+                    ++compared;
+                }
+                else
+                    cout << "# star product coefficient " << known->second << " is not numeric: not compared\n";
+            }
+            else if (compare_filename != "")
+                cout << "# not in " << compare_filename << "\n";
+            cout.flush();
+        }
+    }
+    if (compare_filename != "")
+        cerr << "Compared " << compared << " weights with " << compare_filename << ": largest deviation " << max_deviation << " sigma.\n";
+}
@@ -123,4 +123,23 @@ int main()
     }
     cout << "Number of graphs: " << num_graphs << "\n";
     cout << "(n*(n+1))^n = " << pow(n*(n+1), n) << "\n";
+
+    // The product of the prime factors should be the graph itself (with the same sign), and a prime graph its only factor
+    bool factorization_works = true, hashing_works = true;
+    std::hash<KontsevichGraph> graph_hash;
+    for (auto& g : graphs)
+    {
+        std::vector<KontsevichGraph> factors = g.prime_factors();
+        KontsevichGraph product = factors.front();
+        for (size_t idx = 1; idx != factors.size(); ++idx)
+            product *= factors[idx];
+        if (!(product == g) || product.sign() != g.sign())
+            factorization_works = false;
+        if (g.is_prime() && (factors.size() != 1 || !(factors.front() == g)))
+            factorization_works = false;
+        if (graph_hash(product) != graph_hash(g))
+            hashing_works = false;
+    }
+    cout << "Prime factorization " << (factorization_works ? "works" : "fails") << ".\n";
+    cout << "Hashing equal graphs " << (graph_hash(g_read) == graph_hash(g) && hashing_works ? "works" : "fails") << ".\n";
 }
@@ -1,4 +1,5 @@
 #include "../leibniz_graph.hpp"
+#include "../leibniz_expansion_cache.hpp"
 #include "../kontsevich_graph_sum.hpp"
 #include <ginac/ginac.h>
 #include <iostream>
@@ -8,13 +9,30 @@ using namespace GiNaC;
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    if (argc < 2 || argc > 4)
     {
-        cout << "Usage: " << argv[0] << " <leibniz-graph-series-filename>\n";
+        cout << "Usage: " << argv[0] << " <leibniz-graph-series-filename> [--reduce] [--threads=t]\n\n"
+             << "--reduce      print the reduced sum of all expansions, instead of each expansion separately.\n"
+             << "--threads=t   expand using t threads (default: one per core).\n";
         return 1;
     }
 
     string leibniz_in_filename(argv[1]);
+    bool reduce = false;
+    size_t threads = 0;
+    for (int idx = 2; idx < argc; ++idx)
+    {
+        string argument = argv[idx];
+        if (argument == "--reduce")
+            reduce = true;
+        else if (argument.substr(0, 10) == "--threads=")
+            threads = stoi(argument.substr(10));
+        else
+        {
+            cout << "Unrecognized option: " << argument << "\n";
+            return 1;
+        }
+    }
 
     // Reading in Leibniz graphs
     parser coefficient_reader;
@@ -27,12 +45,31 @@ int main(int argc, char* argv[])
                                                             return coefficient_reader(s);
                                                         });
 
-    KontsevichGraphSum<ex> graph_sum;
+    // XXX: temporary, assume all Leibniz graphs are skew-Leibniz graphs
+    map< LeibnizGraph<ex>, ex> skew_leibniz_graphs;
     for (auto& pair : leibniz_graphs)
     {
         LeibnizGraph<ex> L(pair.first);
-        L.skew(true); // XXX: temporary, assume all Leibniz graphs are skew-Leibniz graphs
-        KontsevichGraphSum<ex> leibniz_expansion = L.expansion(pair.second);
+        L.skew(true);
+        skew_leibniz_graphs[L] = pair.second;
+    }
+
+    LeibnizExpansionCache<ex> expansions;
+    if (reduce)
+    {
+        KontsevichGraphSum<ex> graph_sum = expansions.expansion(skew_leibniz_graphs, threads);
+        for (auto& term : graph_sum)
+            cout << term.second.encoding() << "    " << term.first << "\n";
+        return 0;
+    }
+
+    vector< LeibnizGraph<ex> > graphs;
+    for (auto& pair : skew_leibniz_graphs)
+        graphs.push_back(pair.first);
+    expansions.expand(graphs, threads);
+    for (auto& pair : skew_leibniz_graphs)
+    {
+        KontsevichGraphSum<ex> leibniz_expansion = expansions.expansion(pair.first, pair.second);
         for (auto& term : leibniz_expansion)
         {
             cout << term.second.encoding() << "    " << term.first << "\n";
@@ -6,23 +6,96 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <sstream>
 using namespace std;
 using namespace GiNaC;
 
 int main(int argc, char* argv[])
 {
-    if (argc != 3 || poisson_structures.find(argv[2]) == poisson_structures.end())
+    bool antisymmetric = false, verify = false, usage = argc < 3 || poisson_structures.find(argv[2]) == poisson_structures.end();
+    string derivatives_cache, operators_cache;
+    size_t precompute_order = 0;
+    vector<double> point;
+    ShardingOptions sharding;
+    for (int idx = 3; idx < argc && !usage; ++idx)
     {
-        cerr << "Usage: " << argv[0] << " <graph-series-filename> <poisson-structure>\n\n"
+        string argument = argv[idx];
+        if (argument == "--antisymmetric")
+            antisymmetric = true;
+        else if (argument == "--verify")
+            verify = true;
+        else if (argument.substr(0, 20) == "--derivatives-cache=")
+            derivatives_cache = argument.substr(20);
+        else if (argument.substr(0, 18) == "--operators-cache=")
+            operators_cache = argument.substr(18);
+        else if (argument.substr(0, 13) == "--precompute=")
+            precompute_order = stoi(argument.substr(13));
+        else if (argument.substr(0, 12) == "--processes=")
+            sharding.processes = stoi(argument.substr(12));
+        else if (argument.substr(0, 9) == "--shards=")
+            sharding.shards = stoi(argument.substr(9));
+        else if (argument.substr(0, 11) == "--work-dir=")
+            sharding.directory = argument.substr(11);
+        else if (argument.substr(0, 8) == "--point=")
+        {
+            istringstream values(argument.substr(8));
+            string value;
+            while (getline(values, value, ','))
+                point.push_back(stod(value));
+        }
+        else
+            usage = true;
+    }
+    usage = usage || (!point.empty() && (verify || point.size() != poisson_structures[argv[2]].coordinates.size()));
+    if (usage)
+    {
+        cerr << "Usage: " << argv[0] << " <graph-series-filename> <poisson-structure> [--antisymmetric] [--verify] [--derivatives-cache=dir] [--precompute=k] [--point=x1,...,xn]\n"
+             << "       [--operators-cache=dir] [--processes=N] [--shards=K] [--work-dir=dir]\n\n"
              << "Poisson structures can be chosen from the following list:\n";
         for (auto const& entry : poisson_structures)
         {
             cerr << "- " << entry.first << "\n";
         }
+        cerr << "\n--antisymmetric           enumerate only the index pairs i < j for each internal vertex (using P^{ji} = -P^{ij}).\n"
+             << "--verify                  compute the coefficients also in the other way, and report any difference.\n"
+             << "--derivatives-cache=dir   read (if present) and write the derivatives of the Poisson structure in dir/<poisson-structure>.gar.\n"
+             << "--operators-cache=dir     read (if present) and write the coefficients of the operators of the (prime factors of the) graphs\n"
+             << "                          in dir/<poisson-structure>.operators.gar, so that only new graphs are evaluated (symbolically;\n"
+             << "                          with --processes, the graphs evaluated by the workers are added too).\n"
+             << "--precompute=k            compute all derivatives of the Poisson structure up to order k beforehand.\n"
+             << "--point=x1,...,xn         evaluate the coefficients numerically (in double precision) at the given point (not with --verify);\n"
+             << "                          the coefficients in the graph series must be numbers.\n"
+             << "--processes=N             compute the coefficients (symbolically) in N forked processes.\n"
+             << "--shards=K                divide the terms of each in-degree sector into K shards (default: 4 per process).\n"
+             << "--work-dir=dir            claim the shards from, and write their results to, dir (default: a temporary directory);\n"
+             << "                          other runs with the same dir (e.g. on other machines sharing it) take part in the computation,\n"
+             << "                          and results already in dir are reused. A dir used for a different program, graph series or\n"
+             << "                          Poisson structure is refused. Shards left claimed by a worker that died on this host are\n"
+             << "                          done again; those claimed on other hosts are waited for (and reported).\n";
         return 1;
     }
 
     PoissonStructure& poisson = poisson_structures[argv[2]];
+    sharding.manifest = string("poisson_evaluate\nPoisson structure: ") + argv[2] + "\nGraph series: " + file_fingerprint(argv[1]) + "\n";
+    string derivatives_cache_filename = derivatives_cache + "/" + argv[2] + ".gar";
+    if (derivatives_cache != "")
+    {
+        ifstream derivatives_cache_file(derivatives_cache_filename);
+        if (derivatives_cache_file && !poisson.load_bivector_derivatives(derivatives_cache_file))
+            cerr << "Ignoring " << derivatives_cache_filename << ": it cannot be read, or belongs to a different Poisson structure.\n";
+    }
+    poisson.precompute_bivector_derivatives(precompute_order);
+
+    if (antisymmetric || verify)
+    {
+        for (size_t i = 0; i != poisson.coordinates.size(); ++i)
+            for (size_t j = i; j != poisson.coordinates.size(); ++j)
+                if (!(poisson.bivector[i][j] + poisson.bivector[j][i]).expand().is_zero())
+                {
+                    cerr << "The Poisson structure matrix is not skew-symmetric.\n";
+                    return 1;
+                }
+    }
 
     cout << "Coordinates: ";
     for (symbol coordinate : poisson.coordinates)
@@ -52,6 +125,17 @@ int main(int argc, char* argv[])
     KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, [&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
     size_t order = graph_series.precision();
 
+    GraphOperatorCache operators(poisson, antisymmetric); // shared between all terms (with --processes, the factors computed by the workers are merged in)
+    string operators_cache_filename = operators_cache + "/" + argv[2] + ".operators.gar";
+    if (operators_cache != "")
+    {
+        ifstream operators_cache_file(operators_cache_filename);
+        if (operators_cache_file && !operators.load(operators_cache_file))
+            cerr << "Ignoring " << operators_cache_filename << ": it cannot be read, or belongs to a different Poisson structure.\n";
+    }
+    lst symbols = poisson.symbols(); // for reading results of shards
+    for (auto& entry : coefficient_reader.get_syms())
+        symbols.append(entry.second);
     for (size_t n = 0; n <= order; ++n)
     {
         if (graph_series[n] != 0 || n == order)
@@ -63,13 +147,97 @@ int main(int argc, char* argv[])
                 cout << indegrees[j] << " ";
             cout << "\n";
             
-            map< multi_indexes, ex > coefficients;
-            for (auto& term : graph_series[n][indegrees])
+            if (!point.empty())
             {
-                map_operator_coefficients_from_graph(term.second, poisson, [&coefficients, &term](multi_indexes arg_derivatives, GiNaC::ex summand) {
+                PoissonStructureEvaluator<double> evaluator(poisson, point);
+                map< multi_indexes, double > values;
+                for (auto& term : graph_series[n][indegrees])
+                {
+                    ex coefficient = term.first.evalf();
+                    if (!is_a<numeric>(coefficient) || !ex_to<numeric>(coefficient).is_real())
+                    {
+                        cerr << "The coefficient " << term.first << " is not a number.\n";
+                        return 1;
+                    }
+                    double coefficient_value = ex_to<numeric>(coefficient).to_double();
+                    try {
+                        map_operator_values_at_point<double>(term.second, evaluator, [&values, coefficient_value](multi_indexes arg_derivatives, double summand) {
+                            values[arg_derivatives] += coefficient_value * summand;
+                        }, antisymmetric);
+                    }
+                    catch (std::invalid_argument const& e)
+                    {
+                        cerr << e.what() << "\n";
+                        return 1;
+                    }
+                }
+                for (auto& entry : values)
+                {
+                    cout << "# ";
+                    for (auto mindex = entry.first.begin(); mindex != entry.first.end(); mindex++)
+                    {
+                        cout << "[ ";
+                        for (auto &index : *mindex)
+                            cout << poisson.coordinates[index] << " ";
+                        cout << "]";
+                        if (mindex + 1 != entry.first.end())
+                            cout << " ";
+                    }
+                    cout << "\n" << entry.second << "\n";
+                }
+                cout.flush();
+                continue;
+            }
+
+            KontsevichGraphSum<ex> terms = graph_series[n][indegrees];
+            auto add_term = [&terms, &operators](size_t index, map< multi_indexes, ex >& coefficients) {
+                auto& term = terms.at(index);
+                operators.map_coefficients(term.second, [&coefficients, &term](multi_indexes arg_derivatives, GiNaC::ex summand) {
                     ex result = (term.first * summand).expand();
                     coefficients[arg_derivatives] += result;
                 });
+            };
+            map< multi_indexes, ex > coefficients;
+            if (sharding.enabled())
+            {
+                string name = "h" + to_string(n);
+                for (size_t indegree : indegrees)
+                    name += "_" + to_string(indegree);
+                try {
+                    coefficients = sharded_operator_coefficients(name, terms.size(), add_term, symbols, sharding, &operators);
+                }
+                catch (std::runtime_error const& e)
+                {
+                    cerr << e.what() << "\n";
+                    return 1;
+                }
+            }
+            else
+                for (size_t index = 0; index != terms.size(); ++index)
+                    add_term(index, coefficients);
+            if (verify)
+            {
+                map< multi_indexes, ex > other_coefficients;
+                for (auto& term : graph_series[n][indegrees])
+                {
+                    map_operator_coefficients_from_graph(term.second, poisson, [&other_coefficients, &term](multi_indexes arg_derivatives, GiNaC::ex summand) {
+                        ex result = (term.first * summand).expand();
+                        other_coefficients[arg_derivatives] += result;
+                    }, !antisymmetric);
+                }
+                for (auto& entry : coefficients)
+                    other_coefficients[entry.first] -= entry.second;
+                for (auto& entry : other_coefficients)
+                {
+                    if (!entry.second.expand().is_zero())
+                    {
+                        cerr << "Verification failed for h^" << n << " (in-degrees";
+                        for (size_t j = 0; j != indegrees.size(); ++j)
+                            cerr << " " << indegrees[j];
+                        cerr << ")\n";
+                        return 1;
+                    }
+                }
             }
             for (auto& entry : coefficients)
             {
@@ -92,4 +260,15 @@ int main(int argc, char* argv[])
             cout.flush();
         }
     }
+
+    if (derivatives_cache != "")
+    {
+        ofstream derivatives_cache_file(derivatives_cache_filename);
+        poisson.save_bivector_derivatives(derivatives_cache_file);
+    }
+    if (operators_cache != "")
+    {
+        ofstream operators_cache_file(operators_cache_filename);
+        operators.save(operators_cache_file);
+    }
 }
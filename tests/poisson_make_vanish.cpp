@@ -4,57 +4,238 @@
 #include "../util/factorial.hpp"
 #include "../util/poisson_structure.hpp"
 #include "../util/poisson_structure_examples.hpp" // for poisson_structures
+#include "../util/linear_equation_accumulator.hpp"
+#include "../util/sparse_polynomial.hpp"
+#include "../util/differential_polynomial.hpp"
 #include <ginac/ginac.h>
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <random>
+#include <memory>
+#include <unordered_map>
 using namespace std;
 using namespace GiNaC;
 
-void equations_from_particular_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStructure& poisson, set<ex, ex_is_less>& linear_system, lst& unknowns, vector<size_t> point)
+// A linear form in the unknowns: column (or the number of unknowns, for the constant term) -> coefficient
+typedef map<size_t, cln::cl_RA> LinearForm;
+
+// The coefficients of the graphs as linear forms in the unknowns; returns false if one of them is not linear (with rational coefficients)
+bool linear_forms(KontsevichGraphSum<ex> const& graph_sum, vector<symbol> const& unknowns, vector<LinearForm>& forms)
+{
+    LinearSystemColumns columns;
+    for (size_t col = 0; col != unknowns.size(); ++col)
+        columns[unknowns[col]] = col;
+    forms.clear();
+    try {
+        for (auto& term : graph_sum)
+        {
+            SparseRationalSystem::Row row;
+            numeric rhs;
+            linear_equation_row(term.first, columns, row, rhs);
+            LinearForm form;
+            for (auto& entry : row)
+                form[entry.first] = NumericTraits<cln::cl_RA>::from_numeric(entry.second);
+            if (!rhs.is_zero())
+                form[unknowns.size()] = NumericTraits<cln::cl_RA>::from_numeric(-rhs);
+            forms.push_back(form);
+        }
+    }
+    catch (std::invalid_argument const&)
+    {
+        return false;
+    }
+    return true;
+}
+
+// target += factor * form
+void add_multiple(LinearForm& target, LinearForm const& form, cln::cl_RA const& factor)
+{
+    for (auto& entry : form)
+    {
+        cln::cl_RA& value = target[entry.first];
+        value = value + entry.second * factor;
+    }
+}
+
+ex linear_form_ex(LinearForm const& form, vector<symbol> const& unknowns)
+{
+    ex result = 0;
+    for (auto& entry : form)
+        if (!cln::zerop(entry.second))
+            result += numeric(entry.second) * (entry.first == unknowns.size() ? ex(1) : ex(unknowns[entry.first]));
+    return result;
+}
+
+// How the symbolic operator coefficients of the graphs are computed
+struct CoefficientOptions
+{
+    ShardingOptions sharding;
+    GraphOperatorCache* operators = nullptr; // if set, the symbolic coefficients of (the prime factors of) the graphs are taken from and added to
+                                             // this cache (the exact methods do not use it)
+};
+
+// The (expanded) coefficients of the operator of graph_sum; computed in shards as in ShardingOptions if enabled (the tasks are named after the sector)
+map< multi_indexes, ex > symbolic_coefficients(KontsevichGraphSum<ex> const& graph_sum, PoissonStructure& poisson, vector<symbol> const& unknowns, CoefficientOptions const& options, string const& sector)
+{
+    auto add_term = [&graph_sum, &poisson, &options](size_t index, map< multi_indexes, ex >& coefficients) {
+        auto& term = graph_sum.at(index);
+        auto add_summand = [&coefficients, &term](multi_indexes arg_derivatives, GiNaC::ex summand) {
+            coefficients[arg_derivatives] += (term.first * summand).expand();
+        };
+        if (options.operators != nullptr)
+            options.operators->map_coefficients(term.second, add_summand);
+        else
+            map_operator_coefficients_from_graph(term.second, poisson, add_summand);
+    };
+    if (!options.sharding.enabled())
+    {
+        map< multi_indexes, ex > coefficients;
+        for (size_t index = 0; index != graph_sum.size(); ++index)
+        {
+            add_term(index, coefficients);
+            cerr << "\r" << index + 1 << " / " << graph_sum.size();
+        }
+        return coefficients;
+    }
+    lst symbols = poisson.symbols();
+    for (symbol const& unknown : unknowns)
+        symbols.append(unknown);
+    return sharded_operator_coefficients(sector, graph_sum.size(), add_term, symbols, options.sharding, options.operators);
+}
+
+void equations_from_particular_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStructure& poisson, LinearEquationAccumulator& linear_system, lst& unknowns, vector< vector<numeric> > points,
+                                       CoefficientOptions const& options, string const& sector)
 {
-    lst point_substitution;
-    for (size_t i = 0; i != poisson.coordinates.size(); ++i)
-        point_substitution.append(poisson.coordinates[i] == point[i]);
     typedef std::vector< std::multiset<size_t> > multi_index;
-    map< multi_index, ex > coefficients;
+    vector< map< multi_index, ex > > coefficients(points.size()); // per point
     size_t count = 0;
-    for (auto& term : graph_sum)
+    // The components are evaluated at all points at once, exactly (as rational numbers) if possible
+    vector< vector<cln::cl_RA> > exact_points;
+    for (auto& point : points)
     {
-        map_operator_coefficients_from_graph(term.second, poisson, [&coefficients, &term, &point_substitution](multi_index arg_derivatives, GiNaC::ex summand) {
-            ex result = (term.first * summand).subs(point_substitution).expand();
-            coefficients[arg_derivatives] += result;
-        });
-        cerr << "\r" << ++count << " / " << graph_sum.size();
+        vector<cln::cl_RA> exact_point;
+        for (numeric const& value : point)
+            exact_point.push_back(NumericTraits<cln::cl_RA>::from_numeric(value));
+        exact_points.push_back(exact_point);
     }
-    for (auto& entry : coefficients)
+    PoissonStructureBatchEvaluator<cln::cl_RA> evaluator(poisson, exact_points);
+    try {
+        for (auto& term : graph_sum)
+        {
+            map< multi_index, PointBatch<cln::cl_RA> > values;
+            map_operator_values_at_points<cln::cl_RA>(term.second, evaluator, [&values](multi_index arg_derivatives, PointBatch<cln::cl_RA> summand) {
+                values[arg_derivatives] += summand;
+            });
+            for (auto& entry : values)
+                for (size_t k = 0; k != points.size(); ++k)
+                    if (!cln::zerop(entry.second[k]))
+                        coefficients[k][entry.first] += (term.first * numeric(entry.second[k])).expand();
+            cerr << "\r" << ++count << " / " << graph_sum.size();
+        }
+    }
+    catch (std::invalid_argument const&) // and else symbolically: point by point, or from the symbolic coefficients (cached or sharded)
     {
-        if (entry.second == 0)
-            continue;
-        ex result = entry.second;
-        // TODO: normalize equation
-        pair< set<ex,ex_is_less>::const_iterator, bool > insertion = linear_system.insert(result == 0);
-        if (insertion.second) // new equation
-            cout << result << "==0\n";
+        coefficients.assign(points.size(), map< multi_index, ex >());
+        vector<lst> point_substitutions(points.size());
+        for (size_t k = 0; k != points.size(); ++k)
+            for (size_t i = 0; i != poisson.coordinates.size(); ++i)
+                point_substitutions[k].append(poisson.coordinates[i] == points[k][i]);
+        if (options.operators == nullptr && !options.sharding.enabled())
+        {
+            count = 0;
+            for (auto& term : graph_sum)
+            {
+                for (size_t k = 0; k != points.size(); ++k)
+                    map_operator_coefficients_from_graph(term.second, poisson, [&coefficients, &term, &point_substitutions, k](multi_index arg_derivatives, GiNaC::ex summand) {
+                        coefficients[k][arg_derivatives] += (term.first * summand).subs(point_substitutions[k]).expand();
+                    });
+                cerr << "\r" << ++count << " / " << graph_sum.size();
+            }
+        }
+        else
+        {
+            vector<symbol> unknowns_list;
+            for (ex const& unknown : unknowns)
+                unknowns_list.push_back(ex_to<symbol>(unknown));
+            for (auto& entry : symbolic_coefficients(graph_sum, poisson, unknowns_list, options, sector))
+                for (size_t k = 0; k != points.size(); ++k)
+                    coefficients[k][entry.first] = entry.second.subs(point_substitutions[k]).expand();
+        }
     }
+    for (auto& point_coefficients : coefficients)
+        for (auto& entry : point_coefficients)
+        {
+            if (entry.second == 0)
+                continue;
+            ex result = entry.second;
+            if (linear_system.add(result)) // not implied by the previous equations
+                cout << result << "==0\n";
+        }
     cout.flush();
     cerr << "\n";
 }
 
-void equations_from_polynomial_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStructure& poisson, set<ex, ex_is_less>& linear_system, lst& unknowns)
+// Equations for a polynomial Poisson structure: the coefficients (in the unknowns, and the parameters) of all monomials in the coordinates.
+// If the structure and the coefficients of the graphs allow (polynomial with rational coefficients, resp. linear in the unknowns), the operators are
+// computed with sparse polynomials, accumulated as linear forms in the unknowns per monomial, and the equations are read off in one pass.
+void equations_from_polynomial_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStructure& poisson, PolynomialPoissonStructure* polynomial_poisson, LinearEquationAccumulator& linear_system, vector<symbol> const& unknowns,
+                                      CoefficientOptions const& options, string const& sector)
 {
     typedef std::vector< std::multiset<size_t> > multi_index;
-    map< multi_index, ex > coefficients;
     size_t count = 0;
-    for (auto& term : graph_sum)
+    vector<LinearForm> forms;
+    if (polynomial_poisson != nullptr && !linear_forms(graph_sum, unknowns, forms))
+        polynomial_poisson = nullptr;
+    if (polynomial_poisson != nullptr)
     {
-        map_operator_coefficients_from_graph(term.second, poisson, [&coefficients, &term](multi_index arg_derivatives, GiNaC::ex summand) {
-            ex result = (term.first * summand).expand();
-            coefficients[arg_derivatives] += result;
-        });
-        cerr << "\r" << ++count << " / " << graph_sum.size();
+        // The linear form in the unknowns that is the coefficient of each monomial (in the coordinates and parameters)
+        map< multi_index, map<uint64_t, LinearForm> > coefficients;
+        size_t term_index = 0;
+        for (auto& term : graph_sum)
+        {
+            map< multi_index, SparsePolynomial<cln::cl_RA> > values;
+            map_operator_values_from_graph< SparsePolynomial<cln::cl_RA> >(term.second, poisson,
+                [polynomial_poisson](BivectorDerivativeKey const& key) -> SparsePolynomial<cln::cl_RA> const& { return polynomial_poisson->bivector_derivative(key); },
+                [&values](multi_index arg_derivatives, SparsePolynomial<cln::cl_RA> summand) { values[arg_derivatives] += summand; }, false);
+            LinearForm const& form = forms[term_index++];
+            for (auto& entry : values)
+            {
+                auto& monomial_coefficients = coefficients[entry.first];
+                for (auto& monomial : entry.second.terms())
+                    add_multiple(monomial_coefficients[monomial.first], form, monomial.second);
+            }
+            cerr << "\r" << ++count << " / " << graph_sum.size();
+        }
+        // Group the monomials by their part in the coordinates (the most significant fields)
+        MonomialPacking packing(polynomial_poisson->variables().size());
+        size_t dimension = poisson.coordinates.size();
+        for (auto& entry : coefficients)
+        {
+            for (auto monomial = entry.second.begin(); monomial != entry.second.end(); )
+            {
+                uint64_t coordinates_part = monomial->first >> packing.shift(dimension - 1);
+                ex result = 0;
+                for (; monomial != entry.second.end() && (monomial->first >> packing.shift(dimension - 1)) == coordinates_part; ++monomial)
+                {
+                    ex parameters_monomial = 1;
+                    for (size_t var = dimension; var != packing.variables(); ++var)
+                        parameters_monomial *= pow(polynomial_poisson->variables()[var], (long)packing.exponent(monomial->first, var));
+                    result += parameters_monomial * linear_form_ex(monomial->second, unknowns);
+                }
+                if (result == 0)
+                    continue;
+                if (linear_system.add(result)) // not implied by the previous equations
+                    cout << result << "==0\n";
+            }
+        }
+        cout.flush();
+        cerr << "\n";
+        return;
     }
-    for (auto& entry : coefficients)
+
+    for (auto& entry : symbolic_coefficients(graph_sum, poisson, unknowns, options, sector))
     {
         if (entry.second == 0)
             continue;
@@ -70,9 +251,7 @@ void equations_from_polynomial_poisson(KontsevichGraphSum<ex> graph_sum, Poisson
                 result2 = result2.coeff(poisson.coordinates[i], (*monomialdegrees)[i]).expand();
             if (result2 == 0)
                 continue;
-            // TODO: normalize equation
-            pair< set<ex,ex_is_less>::const_iterator, bool > insertion = linear_system.insert(result2 == 0);
-            if (insertion.second) // new equation
+            if (linear_system.add(result2)) // not implied by the previous equations
                 cout << result2 << "==0\n";
         }
     }
@@ -80,48 +259,91 @@ void equations_from_polynomial_poisson(KontsevichGraphSum<ex> graph_sum, Poisson
     cerr << "\n";
 }
 
-void equations_from_generic_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStructure& poisson, set<ex, ex_is_less>& linear_system, lst& unknowns)
+// Equations for a generic Poisson structure: the coefficients (in the unknowns) of all products of derivatives of the functions.
+// If the structure and the coefficients of the graphs allow, the operators are computed as differential polynomials, accumulated as
+// linear forms in the unknowns per product (by hash), and the equations are read off directly.
+void equations_from_generic_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStructure& poisson, GenericPoissonStructure* generic_poisson, LinearEquationAccumulator& linear_system, vector<symbol> const& unknowns,
+                                    CoefficientOptions const& options, string const& sector)
 {
     typedef std::vector< std::multiset<size_t> > multi_index;
-    map< multi_index, map<ex, ex, ex_is_less> > coefficients;
     size_t count = 0;
-    for (auto& term : graph_sum)
+    vector<LinearForm> forms;
+    if (generic_poisson != nullptr && !linear_forms(graph_sum, unknowns, forms))
+        generic_poisson = nullptr;
+    if (generic_poisson != nullptr)
     {
-        map_operator_coefficients_from_graph(term.second, poisson, [&coefficients, &term](multi_index arg_derivatives, GiNaC::ex summand) {
-                ex result = (term.first * summand).expand();
+        map< multi_index, unordered_map<DifferentialMonomial, LinearForm, DifferentialMonomialHash> > coefficients;
+        size_t term_index = 0;
+        for (auto& term : graph_sum)
+        {
+            map< multi_index, DifferentialPolynomial<cln::cl_RA> > values;
+            map_operator_values_from_graph< DifferentialPolynomial<cln::cl_RA> >(term.second, poisson,
+                [generic_poisson](BivectorDerivativeKey const& key) -> DifferentialPolynomial<cln::cl_RA> const& { return generic_poisson->bivector_derivative(key); },
+                [&values](multi_index arg_derivatives, DifferentialPolynomial<cln::cl_RA> summand) { values[arg_derivatives] += summand; }, false);
+            LinearForm const& form = forms[term_index++];
+            for (auto& entry : values)
+            {
+                auto& monomial_coefficients = coefficients[entry.first];
+                for (auto& monomial : entry.second.terms())
+                    add_multiple(monomial_coefficients[monomial.first], form, monomial.second);
+            }
+            cerr << "\r" << ++count << " / " << graph_sum.size();
+        }
+        for (auto& entry : coefficients)
+        {
+            map<DifferentialMonomial, LinearForm const*> sorted; // for a reproducible order of the equations
+            for (auto& monomial : entry.second)
+                sorted[monomial.first] = &monomial.second;
+            for (auto& monomial : sorted)
+            {
+                ex result = linear_form_ex(*monomial.second, unknowns);
                 if (result == 0)
-                    return;
-                if (!is_a<add>(result))
-                    result = lst({ result });
-                for (auto term : result)
+                    continue;
+                if (linear_system.add(result)) // not implied by the previous equations
+                    cout << result << "==0\n";
+            }
+        }
+        cout.flush();
+        cerr << "\n";
+        return;
+    }
+
+    // Splits an expanded coefficient into the coefficients (in the unknowns) of the products of derivatives of the functions
+    map< multi_index, map<ex, ex, ex_is_less> > coefficients;
+    auto split = [&coefficients](multi_index const& arg_derivatives, ex result) {
+        if (result == 0)
+            return;
+        if (!is_a<add>(result))
+            result = lst({ result });
+        for (auto term : result)
+        {
+            ex coefficient = 1;
+            ex derivatives = 1;
+            if (!is_a<mul>(term))
+                term = lst({ term });
+            for (auto factor : term)
+            {
+                if  (is_a<GiNaC::function>(factor) || is_a<fderivative>(factor))
+                    derivatives *= factor;
+                else if (is_a<numeric>(factor) || is_a<symbol>(factor))
+                    coefficient *= factor;
+                else if (is_a<power>(factor))
                 {
-                    ex coefficient = 1;
-                    ex derivatives = 1;
-                    if (!is_a<mul>(term))
-                        term = lst({ term });
-                    for (auto factor : term)
-                    {
-                        if  (is_a<GiNaC::function>(factor) || is_a<fderivative>(factor))
-                            derivatives *= factor;
-                        else if (is_a<numeric>(factor) || is_a<symbol>(factor))
-                            coefficient *= factor;
-                        else if (is_a<power>(factor))
-                        {
-                            if (is_a<GiNaC::function>(factor.op(0)) || is_a<fderivative>(factor.op(0)))
-                                derivatives *= factor;
-                            else if (is_a<numeric>(factor.op(0)) || is_a<symbol>(factor.op(0)))
-                                coefficient *= factor;
-                        }
-                        else
-                        {
-                            cerr << "What the hell is " << factor << "?\n";
-                        }
-                    }
-                    coefficients[arg_derivatives][derivatives] += coefficient;
+                    if (is_a<GiNaC::function>(factor.op(0)) || is_a<fderivative>(factor.op(0)))
+                        derivatives *= factor;
+                    else if (is_a<numeric>(factor.op(0)) || is_a<symbol>(factor.op(0)))
+                        coefficient *= factor;
                 }
-        });
-        cerr << "\r" << ++count << " / " << graph_sum.size();
-    }
+                else
+                {
+                    cerr << "What the hell is " << factor << "?\n";
+                }
+            }
+            coefficients[arg_derivatives][derivatives] += coefficient;
+        }
+    };
+    for (auto& entry : symbolic_coefficients(graph_sum, poisson, unknowns, options, sector))
+        split(entry.first, entry.second);
     for (auto pair : coefficients)
     {
         for (auto pair2 : pair.second)
@@ -129,9 +351,7 @@ void equations_from_generic_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStr
             ex result2 = pair2.second;
             if (result2 == 0)
                 continue;
-            // TODO: normalize equation
-            auto insertion = linear_system.insert(result2 == 0);
-            if (insertion.second) // new equation
+            if (linear_system.add(result2)) // not implied by the previous equations
                 cout << result2 << "==0\n";
         }
     }
@@ -141,19 +361,78 @@ void equations_from_generic_poisson(KontsevichGraphSum<ex> graph_sum, PoissonStr
 
 int main(int argc, char* argv[])
 {
-    if ((argc != 3 && argc != 4) || poisson_structures.find(argv[2]) == poisson_structures.end())
+    bool solve = false, usage = argc < 3 || poisson_structures.find(argv[2]) == poisson_structures.end();
+    string derivatives_cache, operators_cache;
+    size_t precompute_order = 0, random_points = 0, seed = 0;
+    vector<string> given_points;
+    CoefficientOptions options;
+    for (int idx = 3; idx < argc && !usage; ++idx)
     {
-        cerr << "Usage: " << argv[0] << " <graph-series-filename> <poisson-structure> [--linear-solve]\n\n"
+        string argument = argv[idx];
+        if (argument == "--linear-solve")
+            solve = true;
+        else if (argument.substr(0, 20) == "--derivatives-cache=")
+            derivatives_cache = argument.substr(20);
+        else if (argument.substr(0, 18) == "--operators-cache=")
+            operators_cache = argument.substr(18);
+        else if (argument.substr(0, 13) == "--precompute=")
+            precompute_order = stoi(argument.substr(13));
+        else if (argument.substr(0, 8) == "--point=")
+            given_points.push_back(argument.substr(8));
+        else if (argument.substr(0, 16) == "--random-points=")
+            random_points = stoi(argument.substr(16));
+        else if (argument.substr(0, 7) == "--seed=")
+            seed = stoi(argument.substr(7));
+        else if (argument.substr(0, 12) == "--processes=")
+            options.sharding.processes = stoi(argument.substr(12));
+        else if (argument.substr(0, 9) == "--shards=")
+            options.sharding.shards = stoi(argument.substr(9));
+        else if (argument.substr(0, 11) == "--work-dir=")
+            options.sharding.directory = argument.substr(11);
+        else
+            usage = true;
+    }
+    if (usage)
+    {
+        cerr << "Usage: " << argv[0] << " <graph-series-filename> <poisson-structure> [--linear-solve] [--derivatives-cache=dir] [--precompute=k]\n"
+             << "       [--operators-cache=dir] [--point=x1,...,xn]... [--random-points=K] [--seed=s]\n"
+             << "       [--processes=N] [--shards=K] [--work-dir=dir]\n\n"
              << "Poisson structures can be chosen from the following list:\n";
         for (auto const& entry : poisson_structures)
         {
             cerr << "- " << entry.first << "\n";
         }
+        cerr << "\n--derivatives-cache=dir   read (if present) and write the derivatives of the Poisson structure in dir/<poisson-structure>.gar.\n"
+             << "--operators-cache=dir     read (if present) and write the coefficients of the operators of the (prime factors of the) graphs\n"
+             << "                          in dir/<poisson-structure>.operators.gar, so that only new graphs are evaluated, where the\n"
+             << "                          symbolic coefficients are used (not with the exact methods below; with --processes, the graphs\n"
+             << "                          evaluated by the workers are added too).\n"
+             << "--precompute=k            compute all derivatives of the Poisson structure up to order k beforehand.\n"
+             << "--point=x1,...,xn         for a particular Poisson structure: a point (with rational coordinates) to evaluate at; may be repeated.\n"
+             << "--random-points=K         for a particular Poisson structure: also evaluate at K random points with rational coordinates.\n"
+             << "--seed=s                  the seed for the random points (default: 0).\n"
+             << "Without points, a particular Poisson structure is evaluated at (1, 2, ..., n). The equations at all points are obtained in one pass.\n"
+             << "--processes=N             compute symbolic operator coefficients in N forked processes (not used with the exact methods for\n"
+             << "                          rational points, sparse polynomials and differential polynomials, which are used when possible).\n"
+             << "--shards=K                divide the terms of each in-degree sector into K shards (default: 4 per process).\n"
+             << "--work-dir=dir            claim the shards from, and write their results to, dir (default: a temporary directory);\n"
+             << "                          other runs with the same dir (e.g. on other machines sharing it) take part in the computation,\n"
+             << "                          and results already in dir are reused. A dir used for a different program, graph series or\n"
+             << "                          Poisson structure is refused. Shards left claimed by a worker that died on this host are\n"
+             << "                          done again; those claimed on other hosts are waited for (and reported).\n";
         return 1;
     }
-    bool solve = argc == 4 && string(argv[3]) == "--linear-solve";
 
     PoissonStructure& poisson = poisson_structures[argv[2]];
+    options.sharding.manifest = string("poisson_make_vanish\nPoisson structure: ") + argv[2] + "\nGraph series: " + file_fingerprint(argv[1]) + "\n";
+    string derivatives_cache_filename = derivatives_cache + "/" + argv[2] + ".gar";
+    if (derivatives_cache != "")
+    {
+        ifstream derivatives_cache_file(derivatives_cache_filename);
+        if (derivatives_cache_file && !poisson.load_bivector_derivatives(derivatives_cache_file))
+            cerr << "Ignoring " << derivatives_cache_filename << ": it cannot be read, or belongs to a different Poisson structure.\n";
+    }
+    poisson.precompute_bivector_derivatives(precompute_order);
 
     // Reading in graph series:
     string graph_series_filename(argv[1]);
@@ -164,17 +443,98 @@ int main(int argc, char* argv[])
 
     // Make a list of unknowns
     lst unknowns;
+    vector<symbol> unknowns_list;
     for (std::pair<string, ex> pair : coefficient_reader.get_syms())
+    {
         unknowns.append(pair.second);
+        unknowns_list.push_back(ex_to<symbol>(pair.second));
+    }
+
+    // Points for particular Poisson structure:
+    vector< vector<numeric> > points;
+    parser point_reader;
+    for (string const& given_point : given_points)
+    {
+        vector<numeric> point;
+        istringstream values(given_point);
+        string value;
+        while (getline(values, value, ','))
+        {
+            ex coordinate = point_reader(value);
+            if (!is_a<numeric>(coordinate) || !ex_to<numeric>(coordinate).is_rational())
+            {
+                cerr << "Not a rational number: " << value << "\n";
+                return 1;
+            }
+            point.push_back(ex_to<numeric>(coordinate));
+        }
+        if (point.size() != poisson.coordinates.size())
+        {
+            cerr << "The point " << given_point << " does not have " << poisson.coordinates.size() << " coordinates.\n";
+            return 1;
+        }
+        points.push_back(point);
+    }
+    mt19937 generator(seed);
+    uniform_int_distribution<int> numerator(1, 20), denominator(1, 10), sign(0, 1);
+    for (size_t k = 0; k != random_points; ++k)
+    {
+        vector<numeric> point;
+        for (size_t i = 0; i != poisson.coordinates.size(); ++i)
+        {
+            int a = numerator(generator), b = denominator(generator);
+            point.push_back(numeric(sign(generator) ? a : -a, b)); // nonzero, to avoid the most common singularities
+        }
+        points.push_back(point);
+    }
+    if (points.empty())
+    {
+        vector<numeric> point;
+        for (size_t i = 0; i != poisson.coordinates.size(); ++i)
+            point.push_back(i+1);
+        points.push_back(point);
+    }
 
-    // Point for particular Poisson structure:
-    vector<size_t> point(poisson.coordinates.size());
-    for (size_t i = 0; i != poisson.coordinates.size(); ++i)
-        point[i] = i+1;
-    // Right now, only the point (1, 2, ..., dim). TODO: more points, options
+    // Sparse polynomials for a polynomial Poisson structure, if its entries have rational coefficients:
+    unique_ptr<PolynomialPoissonStructure> polynomial_poisson;
+    if (poisson.type == PoissonStructure::Type::Polynomial)
+    {
+        try {
+            polynomial_poisson.reset(new PolynomialPoissonStructure(poisson));
+        }
+        catch (std::exception const&)
+        {
+            polynomial_poisson.reset();
+        }
+    }
+
+    // Differential polynomials for a generic Poisson structure, if its entries are polynomials in derivatives of functions of the coordinates:
+    unique_ptr<GenericPoissonStructure> generic_poisson;
+    if (poisson.type == PoissonStructure::Type::Generic)
+    {
+        try {
+            generic_poisson.reset(new GenericPoissonStructure(poisson));
+        }
+        catch (std::exception const&)
+        {
+            generic_poisson.reset();
+        }
+    }
+
+    // Coefficients of graph operators from earlier runs:
+    unique_ptr<GraphOperatorCache> operators;
+    string operators_cache_filename = operators_cache + "/" + argv[2] + ".operators.gar";
+    if (operators_cache != "")
+    {
+        operators.reset(new GraphOperatorCache(poisson));
+        ifstream operators_cache_file(operators_cache_filename);
+        if (operators_cache_file && !operators->load(operators_cache_file))
+            cerr << "Ignoring " << operators_cache_filename << ": it cannot be read, or belongs to a different Poisson structure.\n";
+        options.operators = operators.get();
+    }
 
     cerr << "Number of terms:\n";
-    set<ex, ex_is_less> linear_system;
+    LinearEquationAccumulator linear_equations(unknowns_list);
     for (size_t n = 0; n <= order; ++n)
     {
         cerr << "h^" << n << ":\n";
@@ -185,30 +545,56 @@ int main(int argc, char* argv[])
                 cerr << indegrees[j] << " ";
             cerr << ": " << graph_series[n][indegrees].size() << "\n";
             
-            switch (poisson.type)
+            string sector = "h" + to_string(n);
+            for (size_t indegree : indegrees)
+                sector += "_" + to_string(indegree);
+            try {
+                switch (poisson.type)
+                {
+                    case PoissonStructure::Type::Polynomial:
+                        equations_from_polynomial_poisson(graph_series[n][indegrees], poisson, polynomial_poisson.get(), linear_equations, unknowns_list, options, sector);
+                        break;
+                    case PoissonStructure::Type::Generic:
+                        equations_from_generic_poisson(graph_series[n][indegrees], poisson, generic_poisson.get(), linear_equations, unknowns_list, options, sector);
+                        break;
+                    case PoissonStructure::Type::Particular:
+                        equations_from_particular_poisson(graph_series[n][indegrees], poisson, linear_equations, unknowns, points, options, sector);
+                        break;
+                }
+            }
+            catch (std::runtime_error const& e)
             {
-                case PoissonStructure::Type::Polynomial:
-                    equations_from_polynomial_poisson(graph_series[n][indegrees], poisson, linear_system, unknowns);
-                    break;
-                case PoissonStructure::Type::Generic:
-                    equations_from_generic_poisson(graph_series[n][indegrees], poisson, linear_system, unknowns);
-                    break;
-                case PoissonStructure::Type::Particular:
-                    equations_from_particular_poisson(graph_series[n][indegrees], poisson, linear_system, unknowns, point);
-                    break;
+                cerr << e.what() << "\n";
+                return 1;
             }
         }
     }
+    if (derivatives_cache != "")
+    {
+        ofstream derivatives_cache_file(derivatives_cache_filename);
+        poisson.save_bivector_derivatives(derivatives_cache_file);
+    }
+    if (operators_cache != "")
+    {
+        ofstream operators_cache_file(operators_cache_filename);
+        operators->save(operators_cache_file);
+    }
     if (solve)
     {
-        cout << "Got system of " << linear_system.size() << " linear equations in " << unknowns.nops() << " unknowns.\n";
-        lst linear_system_lst;
-        for (ex eq : linear_system)
-            if (eq.lhs() != eq.rhs()) // not a tautology
-                linear_system_lst.append(eq);
+        cout << "Got system of " << linear_equations.rank() << " independent linear equations in " << unknowns.nops() << " unknowns.\n";
+        if (!linear_equations.nonlinear().empty())
+        {
+            cerr << linear_equations.nonlinear().size() << " equations are not linear in the unknowns.\n";
+            return 1;
+        }
         cout << "Solving it...\n";
-        for (ex eq : lsolve(linear_system_lst, unknowns))
-            if (eq.lhs() != eq.rhs()) // not a tautology
+        ExactSolution solution = solve_exact(linear_equations.system());
+        if (!solution.certified)
+            cout << "Could not certify a solution using " << solution.primes << " primes.\n";
+        else if (!solution.consistent)
+            cout << "The linear system has no solution.\n";
+        else
+            for (ex eq : solution_substitutions(solution, unknowns_list))
                 cout << eq << endl;
     }
 }
@@ -0,0 +1,150 @@
+#include "../kontsevich_graph_series.hpp"
+#include "../kontsevich_graph_operator.hpp"
+#include "../util/poisson_structure.hpp"
+#include "../util/poisson_structure_examples.hpp" // for poisson_structures
+#include "../util/sparse_polynomial.hpp"
+#include "../util/modular_evaluation.hpp"
+#include <ginac/ginac.h>
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <memory>
+#include <cmath>
+using namespace std;
+using namespace GiNaC;
+
+// Probabilistic test whether the operators of a graph series vanish for a polynomial Poisson structure (Schwartz-Zippel):
+// the coefficients of the operators are evaluated modulo a prime at random points (in the coordinates, the parameters of the structure,
+// and the symbols in the coefficients of the graphs). A nonzero value is a witness; if all values vanish, the series vanishes with
+// probability at least 1 - (d/p)^K, where d bounds the degree of the coefficients, p is the prime and K the number of points.
+
+int main(int argc, char* argv[])
+{
+    size_t point_count = 4, seed = 0;
+    bool usage = argc < 3 || poisson_structures.find(argv[2]) == poisson_structures.end();
+    for (int idx = 3; idx < argc && !usage; ++idx)
+    {
+        string argument = argv[idx];
+        if (argument.substr(0, 9) == "--points=")
+            point_count = stoi(argument.substr(9));
+        else if (argument.substr(0, 7) == "--seed=")
+            seed = stoi(argument.substr(7));
+        else
+            usage = true;
+    }
+    if (usage || point_count == 0)
+    {
+        cerr << "Usage: " << argv[0] << " <graph-series-filename> <poisson-structure> [--points=K] [--seed=s]\n\n"
+             << "Poisson structures can be chosen from the following list (polynomial ones only):\n";
+        for (auto const& entry : poisson_structures)
+        {
+            if (entry.second.type == PoissonStructure::Type::Polynomial)
+                cerr << "- " << entry.first << "\n";
+        }
+        cerr << "\n--points=K                the number of random points (default: 4).\n"
+             << "--seed=s                  the seed for the random points (default: 0).\n";
+        return 1;
+    }
+
+    PoissonStructure& poisson = poisson_structures[argv[2]];
+    unique_ptr<PolynomialPoissonStructure> polynomial_poisson;
+    try {
+        polynomial_poisson.reset(new PolynomialPoissonStructure(poisson));
+    }
+    catch (std::exception const&)
+    {
+        cerr << "The Poisson structure does not have polynomial entries with rational coefficients.\n";
+        return 1;
+    }
+    size_t entry_degree = 0;
+    for (size_t i = 0; i != poisson.coordinates.size(); ++i)
+        for (size_t j = 0; j != poisson.coordinates.size(); ++j)
+            entry_degree = max(entry_degree, polynomial_poisson->bivector_derivative(BivectorDerivativeKey(i, j)).degree());
+
+    // Reading in graph series:
+    string graph_series_filename(argv[1]);
+    ifstream graph_series_file(graph_series_filename);
+    parser coefficient_reader;
+    KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, [&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
+    size_t order = graph_series.precision();
+    vector<symbol> unknowns;
+    for (auto& entry : coefficient_reader.get_syms())
+        unknowns.push_back(ex_to<symbol>(entry.second));
+
+    // Random points: residues of the variables of the structure, and of the unknowns in the coefficients
+    mt19937_64 generator(seed);
+    uniform_int_distribution<uint64_t> residue(0, Modular::prime - 1);
+    vector< vector<Modular> > points(point_count, vector<Modular>(polynomial_poisson->variables().size()));
+    vector< vector<Modular> > unknown_points(point_count, vector<Modular>(unknowns.size()));
+    for (size_t k = 0; k != point_count; ++k)
+    {
+        for (Modular& value : points[k])
+            value = Modular::from_residue(residue(generator));
+        for (Modular& value : unknown_points[k])
+            value = Modular::from_residue(residue(generator));
+    }
+    ModularPoissonStructureEvaluator evaluator(*polynomial_poisson, points);
+
+    bool all_zero = true;
+    for (size_t n = 0; n <= order; ++n)
+    {
+        bool nonzero = false;
+        size_t degree = 0;
+        for (std::vector<size_t> indegrees : graph_series[n].in_degrees(true))
+        {
+            map< multi_indexes, PointBatch<Modular> > values;
+            try {
+                for (auto& term : graph_series[n][indegrees])
+                {
+                    SparsePolynomial<cln::cl_RA> coefficient = SparsePolynomial<cln::cl_RA>::from_ex(term.first, unknowns);
+                    degree = max(degree, coefficient.degree() + term.second.internal() * entry_degree);
+                    PointBatch<Modular> coefficient_values = modular_value(coefficient, unknown_points);
+                    map_operator_values_from_graph< PointBatch<Modular> >(term.second, poisson,
+                        [&evaluator](BivectorDerivativeKey const& key) -> PointBatch<Modular> const& { return evaluator.bivector_derivative(key); },
+                        [&values, &coefficient_values](multi_indexes arg_derivatives, PointBatch<Modular> summand) {
+                            summand *= coefficient_values;
+                            values[arg_derivatives] += summand;
+                        }, false);
+                }
+            }
+            catch (std::exception const& e)
+            {
+                cerr << "h^" << n << ": " << e.what() << "\n";
+                return 1;
+            }
+            for (auto& entry : values)
+            {
+                size_t k = 0;
+                while (k != point_count && entry.second[k].residue() == 0)
+                    ++k;
+                if (k == point_count)
+                    continue;
+                cout << "h^" << n << ": nonzero; the coefficient of ";
+                for (multi_index const& indices : entry.first)
+                {
+                    cout << "[ ";
+                    for (size_t index : indices)
+                        cout << poisson.coordinates[index] << " ";
+                    cout << "]";
+                }
+                cout << " is " << entry.second[k].residue() << " mod " << Modular::prime << " at ";
+                for (size_t var = 0; var != polynomial_poisson->variables().size(); ++var)
+                    cout << polynomial_poisson->variables()[var] << "=" << points[k][var].residue() << " ";
+                for (size_t var = 0; var != unknowns.size(); ++var)
+                    cout << unknowns[var] << "=" << unknown_points[k][var].residue() << " ";
+                cout << "\n";
+                nonzero = true;
+                break;
+            }
+            if (nonzero)
+                break;
+        }
+        if (nonzero)
+            all_zero = false;
+        else
+            cout << "h^" << n << ": zero with probability >= 1 - " << pow((double)degree / Modular::prime, (double)point_count) << "\n";
+        cout.flush();
+    }
+    return all_zero ? 0 : 2;
+}
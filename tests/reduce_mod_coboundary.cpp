@@ -3,16 +3,21 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <stdexcept>
+#include "../util/linear_system_assembler.hpp"
 using namespace std;
 using namespace GiNaC;
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    if (argc != 2 && (argc != 3 || string(argv[2]) != "--solve"))
     {
-        cout << "Usage: " << argv[0] << " <graph-series-filename>\n";
+        cout << "Usage: " << argv[0] << " <graph-series-filename> [--solve]\n\n"
+             << "When the optional argument [--solve] is specified, the coefficients of the potential primitive (and the undetermined variables in the input)\n"
+             << "are solved for exactly, such that the remainder vanishes.\n";
         return 1;
     }
+    bool solve = argc == 3;
 
     // Reading in graph series:
     string graph_series_filename(argv[1]);
@@ -23,6 +28,9 @@ int main(int argc, char* argv[])
     KontsevichGraphSeries<ex> graph_series_copy = graph_series;
 
     size_t counter = 0;
+    vector<symbol> unknowns;
+    for (auto namevar : coefficient_reader.get_syms())
+        unknowns.push_back(ex_to<symbol>(namevar.second));
 
     KontsevichGraphSeries<ex> potential_primitives;
     potential_primitives.precision(graph_series.precision());
@@ -77,6 +85,7 @@ int main(int argc, char* argv[])
                 {
                     normal_forms.insert(normal_form.second);
                     symbol coefficient("t_" + to_string(counter++));
+                    unknowns.push_back(coefficient);
                     for (auto& term : kgs)
                         term.first *= coefficient;
                     potential_primitive += kgs;
@@ -138,6 +147,7 @@ int main(int argc, char* argv[])
                 {
                     normal_forms.insert(normal_form.second);
                     symbol coefficient("w_" + to_string(counter++));
+                    unknowns.push_back(coefficient);
                     for (auto& term : kgs)
                         term.first *= coefficient;
                     potential_primitive += kgs;
@@ -152,6 +162,41 @@ int main(int argc, char* argv[])
     cout << "Reducing...\n";
     cout.flush();
     graph_series_copy.reduce_mod_skew();
+    if (solve)
+    {
+        vector<ex> equations;
+        for (size_t n = 0; n <= graph_series_copy.precision(); ++n)
+            for (auto& term : graph_series_copy[n])
+                equations.push_back(term.first);
+        cout << "Solving linear system of " << equations.size() << " equations in " << unknowns.size() << " unknowns...\n";
+        ExactSolution solution;
+        try {
+            solution = solve_exact(linear_system(equations, unknowns));
+        }
+        catch (std::invalid_argument const& e)
+        {
+            cerr << e.what() << "\n";
+            return 1;
+        }
+        if (!solution.certified)
+            cout << "Could not certify a solution using " << solution.primes << " primes.\n";
+        else if (!solution.consistent)
+            cout << "Not a coboundary.\n";
+        else
+        {
+            cout << "Coboundary (" << solution.nullspace.size() << " free coefficients set to zero).\n";
+            lst substitution;
+            for (size_t i = 0; i != unknowns.size(); ++i)
+                substitution.append(unknowns[i] == solution.particular[i]);
+            for (auto series : { &graph_series_copy, &potential_primitives })
+            {
+                for (auto& order : *series)
+                    for (auto& term : order.second)
+                        term.first = term.first.subs(substitution);
+                series->reduce_mod_skew();
+            }
+        }
+    }
     for (size_t n = 0; n <= graph_series_copy.precision(); ++n)
     {
         if (graph_series_copy[n] != 0 || n == graph_series.precision())
@@ -1,10 +1,14 @@
 #include "../kontsevich_graph_series.hpp"
 #include "../leibniz_graph.hpp"
+#include "../leibniz_expansion_cache.hpp"
+#include "../jacobi_leibniz_templates.hpp"
+#include "../util/linear_system_assembler.hpp"
 #include <ginac/ginac.h>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <limits>
+#include <unordered_set>
 using namespace std;
 using namespace GiNaC;
 
@@ -15,28 +19,39 @@ int main(int argc, char* argv[])
         cout << "Usage: " << argv[0] << " <graph-series-filename> [optional-arguments]\n\n"
              << "Available optional arguments:\n"
              << "--max-iterations=i     perform at most i iterations.\n"
-             << "--max-jac-indegree=k   restricts the number of arrows falling on Jacobiators to be <= k.\n"
+             << "--max-jac-indegree=k   restricts the number of arrows falling on Jacobiators to be <= k (for --jacobi-templates).\n"
              << "--skew-leibniz         skew-symmetrizes each Leibniz graph before subtracting it with an undetermined coefficient.\n"
+             << "--jacobi-templates     also subtract all Leibniz graphs (with one Jacobiator) in the in-degree sectors of the input, in the first iteration.\n"
              << "--leibniz-in=filename  input graph series already contains Leibniz graphs, with encodings in filename.\n"
              << "--leibniz-out=filename store Leibniz graph encodings in filename (default: standard output).\n"
              << "--linsys-out=filename  store linear system in filename (default: standard output).\n"
-             << "--linsys-format=format write the linear system in this format (options: kgs, ginac, maple).\n"
+             << "--linsys-format=format write the linear system in this format (options: mm (MatrixMarket, default), bin (binary, needs --linsys-out),\n"
+             << "                       kgs, ginac, maple); see util/linear_system_assembler.hpp for mm and bin.\n"
              << "--coeff-prefix=c       let the coefficients of leibniz graphs be c_n.\n"
              << "--solve                the undetermined variables in the input are added to the linear system to-be-solved.\n"
-             << "--interactive          ask whether to continue to the next iteration.\n";
+             << "--exact-solve          solve the final linear system exactly (over the rationals), and print the solution.\n"
+             << "--interactive          ask whether to continue to the next iteration.\n"
+             << "--expansion-cache=filename  reuse Leibniz graph expansions stored in filename, and store new ones there.\n"
+             << "--threads=t            expand Leibniz graphs (and solve) using t threads (default 0: one per core);\n"
+             << "                       if given, also read and normalize the input files using t threads.\n";
         return 1;
     }
 
     bool interactive = false;
     bool solve = false;
+    bool exact_solve = false;
     size_t max_jac_indegree = numeric_limits<size_t>::max();
     size_t max_iterations = numeric_limits<size_t>::max();
     bool skew_leibniz = false;
+    bool jacobi_templates = false;
     string leibniz_in_filename = "";
     string leibniz_out_filename = "";
     string linsys_out_filename = "";
-    string linsys_format = "kgs";
+    string linsys_format = "mm";
     string coefficient_prefix = "c";
+    string expansion_cache_filename = "";
+    bool threaded_input = false;
+    size_t threads = 0;
 
     // Process arguments
     for (int idx = 2; idx < argc; ++idx)
@@ -59,8 +74,15 @@ int main(int argc, char* argv[])
                 leibniz_out_filename = value;
             else if (key == "--linsys-out")
                 linsys_out_filename = value;
-            else if (key == "--linsys-format" && (value == "kgs" || value == "ginac" || value == "maple"))
+            else if (key == "--expansion-cache")
+                expansion_cache_filename = value;
+            else if (key == "--linsys-format" && (value == "mm" || value == "bin" || value == "kgs" || value == "ginac" || value == "maple"))
                 linsys_format = value;
+            else if (key == "--threads")
+            {
+                threaded_input = true;
+                threads = stoi(value);
+            }
             else {
                 cout << "Unrecognized option: " << argument << "\n";
                 return 1;
@@ -70,8 +92,12 @@ int main(int argc, char* argv[])
         {
             if (argument == "--skew-leibniz")
                 skew_leibniz = true;
+            else if (argument == "--jacobi-templates")
+                jacobi_templates = true;
             else if (argument == "--solve")
                 solve = true;
+            else if (argument == "--exact-solve")
+                exact_solve = true;
             else if (argument == "--interactive")
                 interactive = true;
             else {
@@ -81,6 +107,12 @@ int main(int argc, char* argv[])
         }
     }
 
+    if (linsys_format == "bin" && linsys_out_filename == "")
+    {
+        cerr << "The binary linear system format requires --linsys-out.\n";
+        return 1;
+    }
+
     cout << "Options: "
          << "max-iterations = ";
     if (max_iterations == numeric_limits<size_t>::max())
@@ -93,12 +125,16 @@ int main(int argc, char* argv[])
     else
         cout << max_jac_indegree;
     cout << ", solve = " << (solve ? "yes" : "no")
+         << ", exact-solve = " << (exact_solve ? "yes" : "no")
          << ", skew-leibniz = " << (skew_leibniz ? "yes" : "no")
+         << ", jacobi-templates = " << (jacobi_templates ? "yes" : "no")
          << ", leibniz-in = " << (leibniz_in_filename == "" ? "none" : leibniz_in_filename)
          << ", leibniz-out = " << (leibniz_out_filename == "" ? "stdout" : leibniz_out_filename)
          << ", linsys-out = " << (linsys_out_filename == "" ? "stdout" : linsys_out_filename)
          << ", linsys-format = " << linsys_format
          << ", coeff-prefix = " << coefficient_prefix
+         << ", expansion-cache = " << (expansion_cache_filename == "" ? "none" : expansion_cache_filename)
+         << ", threads = " << (threads == 0 ? "one per core" : to_string(threads)) << (threaded_input ? "" : " (input read serially)")
          << ", interactive = " << (interactive ? "yes" : "no") << "\n";
 
     // Reading in Leibniz graphs
@@ -107,12 +143,14 @@ int main(int argc, char* argv[])
 
     if (leibniz_in_filename != "")
     {
-        ifstream leibniz_in_file(leibniz_in_filename);
-        leibniz_graphs = LeibnizGraph<ex>::map_from_istream(leibniz_in_file,
-                                                                [&coefficient_reader](string s) -> ex
-                                                                {
-                                                                    return coefficient_reader(s);
-                                                                });
+        auto leibniz_coefficient_parser = [&coefficient_reader](string s) -> ex { return coefficient_reader(s); };
+        if (threaded_input)
+            leibniz_graphs = LeibnizGraph<ex>::map_from_file(leibniz_in_filename, leibniz_coefficient_parser, threads);
+        else
+        {
+            ifstream leibniz_in_file(leibniz_in_filename);
+            leibniz_graphs = LeibnizGraph<ex>::map_from_istream(leibniz_in_file, leibniz_coefficient_parser);
+        }
     }
     std::vector<ex> leibniz_coeffs;
     for (auto const& pair : leibniz_graphs)
@@ -120,20 +158,25 @@ int main(int argc, char* argv[])
 
     // Reading in graph series
     string graph_series_filename(argv[1]);
-    ifstream graph_series_file(graph_series_filename);
     map<size_t, set< vector<size_t> > > in_degrees;
-    KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file,
-        [&coefficient_reader](string s) -> ex { return coefficient_reader(s); },
-        [&in_degrees](KontsevichGraph graph, size_t order) -> bool
-                                   {
-                                       in_degrees[order].insert(graph.in_degrees());
-                                       return true;
-                                   }
-    );
+    map<size_t, set< pair<size_t, size_t> > > vertex_counts; // (internal, external)
+    auto coefficient_parser = [&coefficient_reader](string s) -> ex { return coefficient_reader(s); };
+    auto in_degrees_filter = [&in_degrees, &vertex_counts](KontsevichGraph graph, size_t order) -> bool
+                             {
+                                 in_degrees[order].insert(graph.in_degrees());
+                                 vertex_counts[order].insert({ graph.internal(), graph.external() });
+                                 return true;
+                             };
+    KontsevichGraphSeries<ex> graph_series;
+    if (threaded_input)
+        graph_series = KontsevichGraphSeries<ex>::from_file(graph_series_filename, coefficient_parser, in_degrees_filter, threads);
+    else
+    {
+        ifstream graph_series_file(graph_series_filename);
+        graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, coefficient_parser, in_degrees_filter);
+    }
     size_t order = graph_series.precision();
 
-    graph_series.reduce_mod_skew();
-
     vector<symbol> unknowns_list;
     for (auto const& namevar : coefficient_reader.get_syms())
         if (find(leibniz_coeffs.begin(), leibniz_coeffs.end(), namevar.second) == leibniz_coeffs.end())
@@ -150,9 +193,55 @@ int main(int argc, char* argv[])
     for (auto& leibniz_coeff : leibniz_coeffs)
         coefficient_list.push_back(ex_to<symbol>(leibniz_coeff));
 
-    KontsevichGraphSeries<ex> leibniz_graph_series = graph_series;
+    // The reduced graph series minus the Leibniz graphs found so far, maintained incrementally
+    vector< KontsevichGraphSumAccumulator<ex> > leibniz_graph_series(order + 1);
+    // Graphs introduced or changed in the last iteration (indices into leibniz_graph_series[n].terms()), starting with the whole series;
+    // a graph that cancelled is skipped, and comes back here if a later expansion revives it
+    vector< vector<size_t> > frontier(order + 1);
+    // The equations (coefficients of the terms) taken apart into rows, brought up to date for the changed terms only
+    LinearSystemColumns columns;
+    vector< vector<SparseRationalSystem::Row> > equation_rows(order + 1);
+    vector< vector<numeric> > equation_rhs(order + 1);
+    vector< vector<bool> > equation_stale(order + 1);
+    auto mark_changed = [&](size_t n) {
+        frontier[n] = leibniz_graph_series[n].take_changed();
+        equation_stale[n].resize(leibniz_graph_series[n].size());
+        for (size_t idx : frontier[n])
+            equation_stale[n][idx] = true;
+    };
+    for (size_t n = 0; n <= order; ++n)
+    {
+        leibniz_graph_series[n] += graph_series[n];
+        mark_changed(n);
+    }
+    // Adds the equations of the nonzero terms to the assembler (for the unknowns in coefficient_list), only taking apart those that changed
+    auto assemble = [&](LinearSystemAssembler& assembler) {
+        for (size_t col = columns.size(); col != coefficient_list.size(); ++col)
+            columns[coefficient_list[col]] = col;
+        for (size_t n = 0; n <= order; ++n)
+        {
+            auto const& terms = leibniz_graph_series[n].terms();
+            equation_rows[n].resize(terms.size());
+            equation_rhs[n].resize(terms.size());
+            for (size_t idx = 0; idx != terms.size(); ++idx)
+            {
+                if (terms.at(idx).first == 0)
+                    continue;
+                if (equation_stale[n][idx])
+                {
+                    linear_equation_row(terms.at(idx).first, columns, equation_rows[n][idx], equation_rhs[n][idx]);
+                    equation_stale[n][idx] = false;
+                }
+                assembler.add_row(equation_rows[n][idx], equation_rhs[n][idx]);
+            }
+        }
+    };
+
+    unordered_set<KontsevichGraph> processed_graphs;
 
-    set<KontsevichGraph> processed_graphs;
+    LeibnizExpansionCache<ex> expansions;
+    if (expansion_cache_filename != "" && expansions.load(expansion_cache_filename))
+        cout << "Loaded " << expansions.size() << " Leibniz graph expansions from " << expansion_cache_filename << "\n";
 
     size_t counter = 0;
     bool converged = false;
@@ -160,73 +249,132 @@ int main(int argc, char* argv[])
     while (!converged && ++step <= max_iterations)
     {
         size_t old_counter = counter;
+        // Leibniz graphs yielding the new graphs, in order of appearance (expanded in parallel below)
+        vector< pair<size_t, LeibnizGraph<ex> > > candidates;
         for (size_t n = 0; n <= order; ++n)
         {
             size_t termcounter = 0;
-            for (auto& term : graph_series[n])
+            for (size_t idx : frontier[n])
             {
-                cerr << "\rProcessing term " << ++termcounter << " / " << graph_series[n].size() << ". ";
+                cerr << "\rProcessing term " << ++termcounter << " / " << frontier[n].size() << ". ";
                 if (skew_leibniz)
                     cerr << "Skew-";
-                cerr << "Leibniz graphs so far: " << counter;
+                cerr << "Leibniz graph candidates: " << candidates.size();
 
-                KontsevichGraph& graph = term.second;
+                auto& term = leibniz_graph_series[n].terms().at(idx);
+                if (term.first == 0) // cancelled
+                    continue;
+                const KontsevichGraph& graph = term.second;
 
                 // Check if this graph has already been processed
                 // TODO: optimization: take minimum of skew symmetrization, if skew_leibniz
-                if (find(processed_graphs.begin(), processed_graphs.end(), graph) != processed_graphs.end())
+                // Use that the terms are reduced (graphs are in normal form with sign +1)
+                if (!processed_graphs.insert(graph).second)
                     continue;
 
-                // Use that the graph series is reduced (graphs are in normal form with sign +1)
-                processed_graphs.insert(graph);
-
                 // Subtract Leibniz graphs that yield this Kontsevich graph
-                for (LeibnizGraph<ex> leibniz_graph : LeibnizGraph<ex>::those_yielding_kontsevich_graph(graph, skew_leibniz))
+                KontsevichGraph yielded_graph = graph;
+                for (LeibnizGraph<ex> leibniz_graph : LeibnizGraph<ex>::those_yielding_kontsevich_graph(yielded_graph, skew_leibniz))
                 {
                     leibniz_graph.normalize();
                     leibniz_graph.sign(1);
                     if (leibniz_graphs.find(leibniz_graph) != leibniz_graphs.end())
                         continue;
-                    symbol coefficient(coefficient_prefix + "_" + to_string(counter));
-                    KontsevichGraphSum<ex> graph_sum = leibniz_graph.expansion(coefficient);
-                    if (graph_sum.size() != 0)
-                    {
-                        coefficient_list.push_back(coefficient);
-                        leibniz_graphs[leibniz_graph] = coefficient;
-                        ++counter;
-                        leibniz_graph_series[n] -= graph_sum;
-                    }
+                    candidates.push_back({ n, leibniz_graph });
                 }
             }
         }
 
-        cout << "\nNumber of Leibniz graphs: " << leibniz_graphs.size() << "\n";
-        cout << "\nNumber of terms (before reducing): " << leibniz_graph_series[order].size() << "\n";
+        // Seed the first iteration with all Jacobi-Leibniz templates in the in-degree sectors of the input
+        if (jacobi_templates && step == 1)
+        {
+            for (size_t n = 0; n <= order; ++n)
+                for (auto& counts : vertex_counts[n])
+                    jacobi_leibniz_templates(counts.first, counts.second, 1, in_degrees[n], max_jac_indegree, [&](vector<KontsevichGraph::VertexPair>& targets)
+                    {
+                        if ((size_t)targets.back().second >= counts.first + counts.second - 2) // Jacobiator acting on itself
+                            return;
+                        LeibnizGraph<ex> leibniz_graph = jacobi_leibniz_graph<ex>(counts.first, counts.second, 1, targets, skew_leibniz);
+                        leibniz_graph.normalize();
+                        leibniz_graph.sign(1);
+                        if (leibniz_graphs.find(leibniz_graph) == leibniz_graphs.end())
+                            candidates.push_back({ n, leibniz_graph });
+                    });
+        }
 
-        cout.flush();
+        cerr << "\nExpanding...\n";
+        vector< LeibnizGraph<ex> > candidate_graphs;
+        for (auto& candidate : candidates)
+            candidate_graphs.push_back(candidate.second);
+        expansions.expand(candidate_graphs, threads);
 
-        cerr << "\nReducing...\n";
-        leibniz_graph_series.reduce_mod_skew();
+        for (auto& candidate : candidates)
+        {
+            LeibnizGraph<ex>& leibniz_graph = candidate.second;
+            if (leibniz_graphs.find(leibniz_graph) != leibniz_graphs.end())
+                continue;
+            symbol coefficient(coefficient_prefix + "_" + to_string(counter));
+            KontsevichGraphSum<ex> graph_sum = expansions.expansion(leibniz_graph, coefficient);
+            if (graph_sum.size() != 0)
+            {
+                coefficient_list.push_back(coefficient);
+                leibniz_graphs[leibniz_graph] = coefficient;
+                ++counter;
+                leibniz_graph_series[candidate.first] -= graph_sum;
+            }
+        }
+        // Only the graphs that are new, or changed (e.g. revived after cancelling), need to be processed in the next iteration
+        for (size_t n = 0; n <= order; ++n)
+            mark_changed(n);
 
-        cout << "\nNumber of terms (after reducing): " << leibniz_graph_series[order].size() << "\n";
+        cout << "\nNumber of Leibniz graphs: " << leibniz_graphs.size() << "\n";
 
-        lst equations;
+        vector<size_t> rows(order + 1);
+        for (size_t n = 0; n <= order; ++n)
+            for (auto& term : leibniz_graph_series[n].terms())
+                if (term.first != 0)
+                    ++rows[n];
+
+        cout << "\nNumber of terms: " << rows[order] << "\n";
 
         ostream* linsys_out_stream = &cout;
         ofstream linsys_out_fstream;
         if (linsys_out_filename != "")
         {
             cout << "Writing linear system to " << linsys_out_filename << "\n";
-            linsys_out_fstream.open(linsys_out_filename);
+            linsys_out_fstream.open(linsys_out_filename, linsys_format == "bin" ? ios::out | ios::binary : ios::out);
             linsys_out_stream = &linsys_out_fstream;
         }
+        if (linsys_format == "mm" || linsys_format == "bin")
+        {
+            LinearSystemAssembler assembler(coefficient_list);
+            assemble(assembler);
+            if (linsys_format == "mm")
+                assembler.write_matrix_market(*linsys_out_stream);
+            else
+            {
+                try {
+                    assembler.write_binary(*linsys_out_stream);
+                }
+                catch (std::overflow_error const&)
+                {
+                    cerr << "An entry of the linear system does not fit in 64 bits; writing it in MatrixMarket format instead "
+                         << "(use --linsys-format=mm to avoid this).\n";
+                    linsys_out_fstream.close();
+                    linsys_out_fstream.open(linsys_out_filename, ios::out | ios::trunc);
+                    assembler.write_matrix_market(*linsys_out_stream);
+                }
+            }
+        }
         if (linsys_format == "maple")
             (*linsys_out_stream) << "solve({";
         for (size_t n = 0; n <= order; ++n)
         {
             size_t term_no = 0;
-            for (auto& term : leibniz_graph_series[n])
+            for (auto& term : leibniz_graph_series[n].terms())
             {
+                if (term.first == 0)
+                    continue;
                 if (linsys_format == "kgs")
                     (*linsys_out_stream) << term.second.encoding() << "    " << term.first << "==0\n";
                 else if (linsys_format == "ginac")
@@ -234,21 +382,22 @@ int main(int argc, char* argv[])
                 else if (linsys_format == "maple")
                 {
                     (*linsys_out_stream) << term.first << "=0";
-                    if (term_no != leibniz_graph_series[n].size() - 1)
+                    if (term_no != rows[n] - 1)
                         (*linsys_out_stream) << ",";
                     (*linsys_out_stream) << "\n";
                 }
-                equations.append(term.first);
                 ++term_no;
             }
         }
         if (linsys_format == "maple")
             (*linsys_out_stream) << "});\n";
 
-        size_t rows = equations.nops();
         size_t cols = coefficient_list.size();
 
-        cout << "Got linear system of size " << rows << " x " << cols << ".\n";
+        size_t total_rows = 0;
+        for (size_t n = 0; n <= order; ++n)
+            total_rows += rows[n];
+        cout << "Got linear system of size " << total_rows << " x " << cols << ".\n";
 
         char iterate = 'Y';
         if (interactive)
@@ -259,10 +408,15 @@ int main(int argc, char* argv[])
         if (iterate != 'Y')
             break;
 
-        graph_series = leibniz_graph_series;
-
         converged = counter == old_counter;
     }
+    if (expansion_cache_filename != "")
+    {
+        if (expansions.save(expansion_cache_filename))
+            cout << "\nStored " << expansions.size() << " Leibniz graph expansions in " << expansion_cache_filename << "\n";
+        else
+            cerr << "\nCould not write Leibniz graph expansions to " << expansion_cache_filename << "\n";
+    }
     if (converged)
         cout << "\nConverged in " << step << " steps.\n\n";
     if (skew_leibniz)
@@ -283,4 +437,22 @@ int main(int argc, char* argv[])
         (*leibniz_out_stream) << pair.first.encoding() << "    " << pair.second << "\n";
     }
     leibniz_out_fstream.close();
+
+    if (exact_solve)
+    {
+        cout << "Solving linear system exactly...\n";
+        LinearSystemAssembler assembler(coefficient_list);
+        assemble(assembler);
+        ExactSolution solution = solve_exact(assembler.system(), threads);
+        if (!solution.certified)
+            cout << "Could not certify a solution using " << solution.primes << " primes.\n";
+        else if (!solution.consistent)
+            cout << "The linear system has no solution.\n";
+        else
+        {
+            cout << "Solution (rank " << solution.rank << ", " << solution.nullspace.size() << " free coefficients):\n";
+            for (ex substitution : solution_substitutions(solution, coefficient_list))
+                cout << substitution << "\n";
+        }
+    }
 }
@@ -1,4 +1,4 @@
-#include "../kontsevich_graph_series.hpp"
+#include "../kontsevich_graph_pipeline.hpp"
 #include <ginac/ginac.h>
 #include <iostream>
 #include <fstream>
@@ -33,8 +33,8 @@ int main(int argc, char* argv[])
     string graph_series_filename(argv[1]);
     ifstream graph_series_file(graph_series_filename);
     parser coefficient_reader;
-    KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, [&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
-    graph_series.reduce_mod_skew();
+    KontsevichGraphPipeline<ex> pipeline([&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
+    KontsevichGraphSeries<ex> graph_series = pipeline.reduce_mod_skew(graph_series_file); // only the distinct graphs are kept in memory
 
     for (size_t n = 0; n <= graph_series.precision(); ++n)
     {
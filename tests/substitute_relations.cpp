@@ -1,7 +1,8 @@
-#include "../kontsevich_graph_series.hpp"
+#include "../kontsevich_graph_pipeline.hpp"
 #include <ginac/ginac.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 using namespace std;
 using namespace GiNaC;
@@ -24,16 +25,12 @@ int main(int argc, char* argv[])
         relations.append(coefficient_reader(lhs) == coefficient_reader(rhs));
     }
 
-    // Reading in graphs and their (possibly symbolic) coefficients:
+    // Streaming graphs and their (possibly symbolic) coefficients through the substitution:
     ifstream graph_series_file(graph_series_filename);
-    KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, [&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
-
-    for (size_t n = 0; n <= graph_series.precision(); ++n)
-    {
-        cout << "h^" << n << ":\n";
-        for (auto& term : graph_series[n])
-        {
-            cout << term.second.encoding() << "    " << term.first.subs(relations) << "\n";
-        }
-    }
+    KontsevichGraphPipeline<ex> pipeline([&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
+    pipeline.map_terms(graph_series_file, cout, [&relations](size_t, KontsevichGraphSum<ex>::Term& term, KontsevichGraphPipeline<ex>::Emit const& emit) {
+        stringstream ss;
+        ss << term.second.encoding() << "    " << term.first.subs(relations) << "\n";
+        emit(ss.str());
+    });
 }
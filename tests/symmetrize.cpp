@@ -1,7 +1,8 @@
-#include "../kontsevich_graph_series.hpp"
+#include "../kontsevich_graph_pipeline.hpp"
 #include <ginac/ginac.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 using namespace std;
 using namespace GiNaC;
 
@@ -13,20 +14,15 @@ int main(int argc, char* argv[])
         return 1;
     }
     
-    // Reading in graph series:
+    // Streaming graph series (the symmetrization is term by term):
     string graph_series_filename(argv[1]);
     ifstream graph_series_file(graph_series_filename);
     parser coefficient_reader;
-    KontsevichGraphSeries<ex> graph_series = KontsevichGraphSeries<ex>::from_istream(graph_series_file, [&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
-
-    graph_series = graph_series.symmetrization();
-
-    for (size_t n = 0; n <= graph_series.precision(); ++n)
-    {
-        cout << "h^" << n << ":\n";
-        for (auto& term : graph_series[n])
-        {
-            cout << term.second.encoding() << "    " << term.first << "\n";
-        }
-    }
+    KontsevichGraphPipeline<ex> pipeline([&coefficient_reader](std::string s) -> ex { return coefficient_reader(s); });
+    pipeline.map_terms(graph_series_file, cout, [](size_t, KontsevichGraphSum<ex>::Term& term, KontsevichGraphPipeline<ex>::Emit const& emit) {
+        stringstream ss;
+        for (auto& permuted_term : KontsevichGraphSum<ex>({ term }).symmetrization())
+            ss << permuted_term.second.encoding() << "    " << permuted_term.first << "\n";
+        emit(ss.str());
+    });
 }
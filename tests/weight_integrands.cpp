@@ -8,9 +8,11 @@ using namespace GiNaC;
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    bool integrand = argc == 3 && string(argv[2]) == "--integrand";
+    if (argc != 2 && !integrand)
     {
-        cout << "Usage: " << argv[0] << " <graph-series-filename>\n";
+        cout << "Usage: " << argv[0] << " <graph-series-filename> [--integrand]\n\n"
+             << "Prints the Jacobian of the Gauss map of each graph, or with --integrand its determinant.\n";
         return 1;
     }
     
@@ -26,7 +28,10 @@ int main(int argc, char* argv[])
         for (auto& term : graph_series[n])
         {
             cout << "# " << term.second.encoding() << "    " << term.first << "\n";
-            cout << gauss_map_jacobian(term.second) << "\n";
+            if (integrand)
+                cout << weight_integrand(term.second) << "\n";
+            else
+                cout << gauss_map_jacobian(term.second) << "\n";
         }
     }
 }
@@ -0,0 +1,69 @@
+#ifndef INCLUDED_BOUNDED_QUEUE_H_
+#define INCLUDED_BOUNDED_QUEUE_H_
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Blocking FIFO queue holding at most `capacity` items (producers wait while it is full)
+template <class T>
+class BoundedQueue
+{
+    std::deque<T> d_items;
+    size_t d_capacity;
+    bool d_closed = false;
+    std::mutex d_mutex;
+    std::condition_variable d_not_empty;
+    std::condition_variable d_not_full;
+
+    public:
+    BoundedQueue(size_t capacity)
+    : d_capacity(capacity == 0 ? 1 : capacity)
+    {}
+
+    // Returns false (and drops the item) if the queue has been closed
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        d_not_full.wait(lock, [this]() { return d_closed || d_items.size() < d_capacity; });
+        if (d_closed)
+            return false;
+        d_items.push_back(std::move(item));
+        d_not_empty.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and drained
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(d_mutex);
+        d_not_empty.wait(lock, [this]() { return d_closed || !d_items.empty(); });
+        if (d_items.empty())
+            return false;
+        item = std::move(d_items.front());
+        d_items.pop_front();
+        d_not_full.notify_one();
+        return true;
+    }
+
+    // No more pushes; pending items can still be popped
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        d_closed = true;
+        d_not_empty.notify_all();
+        d_not_full.notify_all();
+    }
+
+    // Close and discard pending items (to unblock producers when the consumer gives up)
+    void abort()
+    {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        d_closed = true;
+        d_items.clear();
+        d_not_empty.notify_all();
+        d_not_full.notify_all();
+    }
+};
+
+#endif
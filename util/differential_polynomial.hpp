@@ -0,0 +1,266 @@
+#ifndef INCLUDED_DIFFERENTIAL_POLYNOMIAL_H_
+#define INCLUDED_DIFFERENTIAL_POLYNOMIAL_H_
+
+#include "poisson_structure.hpp"
+#include "poisson_structure_evaluator.hpp" // for NumericTraits
+#include "hash_combine.hpp"
+#include <ginac/ginac.h>
+#include <cln/cln.h>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+// A derivative of one of the (generic) functions of the coordinates, packed into a 64-bit word:
+// the function id in the most significant byte, followed by the number of derivatives by each coordinate (at most 7), one byte each
+namespace jet_variable
+{
+    const size_t max_coordinates = 7;
+
+    inline uint64_t make(size_t function_id, std::vector<size_t> const& derivatives)
+    {
+        if (function_id > 255 || derivatives.size() > max_coordinates)
+            throw std::length_error("jet_variable: too many functions or coordinates");
+        uint64_t variable = uint64_t(function_id) << 56;
+        for (size_t c = 0; c != derivatives.size(); ++c)
+        {
+            if (derivatives[c] > 255)
+                throw std::length_error("jet_variable: too many derivatives");
+            variable |= uint64_t(derivatives[c]) << (48 - 8*c);
+        }
+        return variable;
+    }
+
+    inline size_t function_id(uint64_t variable) { return variable >> 56; }
+    inline size_t derivatives(uint64_t variable, size_t c) { return (variable >> (48 - 8*c)) & 255; }
+
+    // Throws std::length_error if there would be too many derivatives
+    inline uint64_t differentiate(uint64_t variable, size_t c)
+    {
+        if (derivatives(variable, c) == 255)
+            throw std::length_error("jet_variable: too many derivatives");
+        return variable + (uint64_t(1) << (48 - 8*c));
+    }
+}
+
+// A product of jet variables: sorted, with repetitions
+typedef std::vector<uint64_t> DifferentialMonomial;
+
+struct DifferentialMonomialHash
+{
+    size_t operator()(DifferentialMonomial const& monomial) const
+    {
+        size_t seed = monomial.size();
+        for (uint64_t variable : monomial)
+            hash_combine(seed, variable);
+        return seed;
+    }
+};
+
+// Polynomial in the jet variables with coefficients in C (e.g. cln::cl_RA): the nonzero terms, sorted by monomial
+template<class C>
+class DifferentialPolynomial
+{
+    public:
+    typedef std::pair<DifferentialMonomial, C> Term;
+
+    private:
+    std::vector<Term> d_terms;
+
+    // Sorts terms, adds those with the same monomial, and removes zeros
+    void normalize()
+    {
+        std::sort(d_terms.begin(), d_terms.end(), [](Term const& a, Term const& b) { return a.first < b.first; });
+        size_t kept = 0;
+        for (size_t idx = 0; idx != d_terms.size(); )
+        {
+            size_t first = idx;
+            C coefficient = d_terms[idx].second;
+            for (++idx; idx != d_terms.size() && d_terms[idx].first == d_terms[first].first; ++idx)
+                coefficient = coefficient + d_terms[idx].second;
+            if (!NumericTraits<C>::is_zero(coefficient))
+            {
+                if (kept != first)
+                    d_terms[kept].first.swap(d_terms[first].first);
+                d_terms[kept++].second = coefficient;
+            }
+        }
+        d_terms.resize(kept);
+    }
+
+    public:
+    DifferentialPolynomial(int value = 0)
+    {
+        if (value != 0)
+            d_terms.push_back({ DifferentialMonomial(), C(value) });
+    }
+
+    explicit DifferentialPolynomial(std::vector<Term> const& terms)
+    : d_terms(terms)
+    {
+        for (Term& term : d_terms)
+            std::sort(term.first.begin(), term.first.end());
+        normalize();
+    }
+
+    std::vector<Term> const& terms() const { return d_terms; }
+    bool is_zero() const { return d_terms.empty(); }
+
+    // Merges the (sorted) terms, moving those of this polynomial instead of copying their monomials
+    DifferentialPolynomial& operator+=(DifferentialPolynomial const& other)
+    {
+        std::vector<Term> sum;
+        sum.reserve(d_terms.size() + other.d_terms.size());
+        auto first = d_terms.begin(), second = other.d_terms.begin();
+        while (first != d_terms.end() || second != other.d_terms.end())
+        {
+            if (second == other.d_terms.end() || (first != d_terms.end() && first->first < second->first))
+                sum.push_back(std::move(*first++));
+            else if (first == d_terms.end() || second->first < first->first)
+                sum.push_back(*second++);
+            else
+            {
+                C coefficient = first->second + second->second;
+                if (!NumericTraits<C>::is_zero(coefficient))
+                    sum.push_back({ std::move(first->first), coefficient });
+                ++first;
+                ++second;
+            }
+        }
+        d_terms.swap(sum);
+        return *this;
+    }
+
+    DifferentialPolynomial& operator*=(DifferentialPolynomial const& other)
+    {
+        std::vector<Term> product;
+        product.reserve(d_terms.size() * other.d_terms.size());
+        for (Term const& a : d_terms)
+            for (Term const& b : other.d_terms)
+            {
+                DifferentialMonomial monomial(a.first.size() + b.first.size());
+                std::merge(a.first.begin(), a.first.end(), b.first.begin(), b.first.end(), monomial.begin());
+                product.push_back({ monomial, a.second * b.second });
+            }
+        d_terms.swap(product);
+        normalize();
+        return *this;
+    }
+
+    DifferentialPolynomial operator-() const
+    {
+        DifferentialPolynomial result(*this);
+        for (Term& term : result.d_terms)
+            term.second = -term.second;
+        return result;
+    }
+
+    // The total derivative by the coordinate with index c (by the Leibniz rule; a repeated factor is differentiated once per occurrence)
+    DifferentialPolynomial diff(size_t c) const
+    {
+        DifferentialPolynomial result;
+        for (Term const& term : d_terms)
+            for (size_t idx = 0; idx != term.first.size(); ++idx)
+            {
+                DifferentialMonomial monomial = term.first;
+                monomial[idx] = jet_variable::differentiate(monomial[idx], c);
+                std::sort(monomial.begin(), monomial.end());
+                result.d_terms.push_back({ monomial, term.second });
+            }
+        result.normalize();
+        return result;
+    }
+};
+
+template<class C>
+struct NumericTraits< DifferentialPolynomial<C> >
+{
+    static bool is_zero(DifferentialPolynomial<C> const& value) { return value.is_zero(); }
+};
+
+// The bivector components of a Poisson structure whose entries are polynomials (with rational coefficients) in generic functions
+// of all coordinates (e.g. phi(x,y,z)) and their derivatives, and the derivatives of the components (computed on first use),
+// as differential polynomials in jet variables
+class GenericPoissonStructure
+{
+    PoissonStructure& d_poisson;
+    std::map<unsigned, size_t> d_function_ids; // serial -> id
+    std::unordered_map<BivectorDerivativeKey, DifferentialPolynomial<cln::cl_RA>, BivectorDerivativeKeyHash> d_derivatives;
+
+    uint64_t variable(GiNaC::ex const& factor)
+    {
+        using namespace GiNaC;
+        if (!is_a<GiNaC::function>(factor) || factor.nops() != d_poisson.coordinates.size())
+            throw std::invalid_argument("GenericPoissonStructure: not a function of the coordinates");
+        for (size_t c = 0; c != factor.nops(); ++c)
+            if (!factor.op(c).is_equal(d_poisson.coordinates[c]))
+                throw std::invalid_argument("GenericPoissonStructure: not a function of the coordinates");
+        unsigned serial = ex_to<GiNaC::function>(factor).get_serial();
+        auto known = d_function_ids.find(serial);
+        if (known == d_function_ids.end())
+            known = d_function_ids.insert({ serial, d_function_ids.size() }).first;
+        std::vector<size_t> derivatives(d_poisson.coordinates.size());
+        if (is_a<fderivative>(factor))
+            for (unsigned c : ex_to<fderivative>(factor).derivatives())
+                ++derivatives[c];
+        return jet_variable::make(known->second, derivatives);
+    }
+
+    DifferentialPolynomial<cln::cl_RA> from_ex(GiNaC::ex const& expression)
+    {
+        using namespace GiNaC;
+        std::vector< DifferentialPolynomial<cln::cl_RA>::Term > terms;
+        auto add_term = [&](ex const& term) {
+            DifferentialPolynomial<cln::cl_RA>::Term result { DifferentialMonomial(), 1 };
+            auto add_factor = [&](ex const& factor) {
+                if (is_a<numeric>(factor))
+                    result.second = result.second * NumericTraits<cln::cl_RA>::from_numeric(ex_to<numeric>(factor));
+                else if (is_a<power>(factor) && is_a<numeric>(factor.op(1)) && ex_to<numeric>(factor.op(1)).is_pos_integer())
+                    result.first.insert(result.first.end(), ex_to<numeric>(factor.op(1)).to_long(), variable(factor.op(0)));
+                else
+                    result.first.push_back(variable(factor));
+            };
+            if (is_a<mul>(term))
+                for (ex const& factor : term)
+                    add_factor(factor);
+            else
+                add_factor(term);
+            terms.push_back(result);
+        };
+        ex expanded = expression.expand();
+        if (is_a<add>(expanded))
+            for (ex const& term : expanded)
+                add_term(term);
+        else if (!expanded.is_zero())
+            add_term(expanded);
+        return DifferentialPolynomial<cln::cl_RA>(terms);
+    }
+
+    public:
+    // Throws std::invalid_argument if an entry is not of the required form (or std::length_error if there are too many coordinates)
+    GenericPoissonStructure(PoissonStructure& poisson)
+    : d_poisson(poisson)
+    {
+        if (poisson.coordinates.size() > jet_variable::max_coordinates)
+            throw std::length_error("GenericPoissonStructure: too many coordinates");
+        for (size_t i = 0; i != poisson.coordinates.size(); ++i)
+            for (size_t j = 0; j != poisson.coordinates.size(); ++j)
+                d_derivatives[BivectorDerivativeKey(i, j)] = from_ex(poisson.bivector[i][j]);
+    }
+
+    PoissonStructure& poisson() { return d_poisson; }
+
+    DifferentialPolynomial<cln::cl_RA> const& bivector_derivative(BivectorDerivativeKey const& key)
+    {
+        auto cached = d_derivatives.find(key);
+        if (cached != d_derivatives.end())
+            return cached->second;
+        DifferentialPolynomial<cln::cl_RA> derivative = bivector_derivative(key.without_last()).diff(key.derivative(key.derivatives() - 1));
+        return d_derivatives.insert({ key, derivative }).first->second;
+    }
+};
+
+#endif
@@ -0,0 +1,410 @@
+#ifndef INCLUDED_EXACT_LINEAR_SOLVER_H_
+#define INCLUDED_EXACT_LINEAR_SOLVER_H_
+
+#include "parallel.hpp"
+#include <ginac/ginac.h>
+#include <vector>
+#include <map>
+#include <queue>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <limits>
+
+// Exact solution of sparse linear systems A x = b over the rationals.
+//
+// The (integer-scaled) system is brought to reduced row echelon form modulo several primes below 2^31, the echelon forms belonging to
+// the generic pivot columns are combined by the Chinese remainder theorem, and the entries are recovered by rational reconstruction.
+// The result is verified over the rationals: a particular solution (or a proof that there is none) and a basis of the kernel of A.
+
+struct SparseRationalSystem
+{
+    typedef std::vector< std::pair<size_t, GiNaC::numeric> > Row;
+
+    size_t cols = 0;
+    std::vector<Row> rows; // sparse rows of A (column indices < cols, no repeated columns)
+    std::vector<GiNaC::numeric> rhs; // b
+
+    void add_row(Row const& row, GiNaC::numeric const& value)
+    {
+        rows.push_back(row);
+        rhs.push_back(value);
+    }
+};
+
+struct ExactSolution
+{
+    typedef std::vector< std::pair<size_t, GiNaC::numeric> > SparseVector;
+
+    bool certified = false; // verified over the rationals (if false, nothing else is meaningful)
+    bool consistent = false;
+    size_t rank = 0;
+    size_t primes = 0; // number of primes used
+    std::vector<size_t> pivots; // pivot columns of A, increasing
+    std::vector<GiNaC::numeric> particular; // if consistent: a solution, with the free variables set to zero
+    std::vector<size_t> free_columns; // the other columns, increasing
+    std::vector<SparseVector> nullspace; // kernel basis: nullspace[i] has a 1 in free_columns[i], zeros in the other free columns
+};
+
+namespace exact_linear_solver
+{
+    typedef std::vector< std::pair<size_t, uint64_t> > ModularRow;
+
+    struct ModularEchelon
+    {
+        std::vector<size_t> pivots; // increasing
+        std::vector<ModularRow> rows; // rows[i] has a leading 1 in pivots[i], which is not stored
+    };
+
+    inline uint64_t inverse_mod(uint64_t a, uint64_t p)
+    {
+        int64_t t = 0, new_t = 1, r = p, new_r = a;
+        while (new_r != 0)
+        {
+            int64_t q = r / new_r, tmp;
+            tmp = t - q * new_t; t = new_t; new_t = tmp;
+            tmp = r - q * new_r; r = new_r; new_r = tmp;
+        }
+        return t < 0 ? t + p : t;
+    }
+
+    // Primes below 2^31, in decreasing order (so that products of residues fit in 64 bits)
+    inline uint64_t nth_prime(size_t n)
+    {
+        static std::vector<uint64_t> primes;
+        for (uint64_t candidate = primes.empty() ? (1ULL << 31) - 1 : primes.back() - 2; primes.size() <= n; candidate -= 2)
+        {
+            bool prime = true;
+            for (uint64_t d = 3; d * d <= candidate && prime; d += 2)
+                prime = candidate % d != 0;
+            if (prime)
+                primes.push_back(candidate);
+        }
+        return primes[n];
+    }
+
+    // Reduced row echelon form modulo p of a matrix with `cols` columns. Rows are reduced one at a time against the pivot rows found so far,
+    // sparsest first, using a dense scratch row and a queue of its nonzero columns; the pivot rows are back-substituted at the end.
+    inline ModularEchelon rref(std::vector<ModularRow> const& matrix, size_t cols, uint64_t p)
+    {
+        const size_t none = std::numeric_limits<size_t>::max();
+        std::vector<size_t> pivot_row(cols, none);
+        std::vector<ModularRow> rows;
+        std::vector<uint64_t> dense(cols, 0);
+        std::vector<bool> queued(cols, false);
+        std::priority_queue< size_t, std::vector<size_t>, std::greater<size_t> > queue;
+
+        // Eliminate the pivot columns from the row
+        auto reduce = [&](ModularRow const& row) {
+            for (auto& entry : row)
+            {
+                dense[entry.first] = entry.second;
+                queued[entry.first] = true;
+                queue.push(entry.first);
+            }
+            ModularRow result;
+            while (!queue.empty())
+            {
+                size_t col = queue.top();
+                queue.pop();
+                queued[col] = false;
+                uint64_t value = dense[col];
+                dense[col] = 0;
+                if (value == 0)
+                    continue;
+                if (pivot_row[col] == none)
+                {
+                    result.push_back({ col, value });
+                    continue;
+                }
+                for (auto& entry : rows[pivot_row[col]]) // only columns > col
+                {
+                    dense[entry.first] = (dense[entry.first] + (p - entry.second) * value) % p;
+                    if (!queued[entry.first])
+                    {
+                        queued[entry.first] = true;
+                        queue.push(entry.first);
+                    }
+                }
+            }
+            return result;
+        };
+
+        std::vector<size_t> order(matrix.size());
+        for (size_t idx = 0; idx != order.size(); ++idx)
+            order[idx] = idx;
+        std::stable_sort(order.begin(), order.end(), [&matrix](size_t a, size_t b) { return matrix[a].size() < matrix[b].size(); });
+
+        std::vector<size_t> pivots;
+        for (size_t idx : order)
+        {
+            ModularRow row = reduce(matrix[idx]);
+            if (row.empty())
+                continue;
+            size_t pivot = row.front().first;
+            uint64_t scale = inverse_mod(row.front().second, p);
+            row.erase(row.begin());
+            for (auto& entry : row)
+                entry.second = entry.second * scale % p;
+            pivot_row[pivot] = rows.size();
+            pivots.push_back(pivot);
+            rows.push_back(row);
+        }
+
+        // Back-substitution, starting with the last pivot: the rows with larger pivots are already reduced
+        std::sort(pivots.begin(), pivots.end());
+        ModularEchelon echelon;
+        echelon.pivots = pivots;
+        for (auto pivot = pivots.rbegin(); pivot != pivots.rend(); ++pivot)
+            rows[pivot_row[*pivot]] = reduce(rows[pivot_row[*pivot]]);
+        for (size_t pivot : pivots)
+            echelon.rows.push_back(std::move(rows[pivot_row[pivot]]));
+        return echelon;
+    }
+
+    // Rational number r/s congruent to a modulo m, with |r|, |s| <= sqrt(m/2), if it exists (Wang's algorithm)
+    inline bool rational_reconstruction(GiNaC::numeric const& a, GiNaC::numeric const& m, GiNaC::numeric& result)
+    {
+        GiNaC::numeric bound = GiNaC::isqrt(GiNaC::iquo(m, 2));
+        GiNaC::numeric r0 = m, r1 = a, s0 = 0, s1 = 1;
+        while (bound < r1)
+        {
+            GiNaC::numeric q = GiNaC::iquo(r0, r1), tmp;
+            tmp = r0 - q * r1; r0 = r1; r1 = tmp;
+            tmp = s0 - q * s1; s0 = s1; s1 = tmp;
+        }
+        if (bound < GiNaC::abs(s1) || GiNaC::gcd(r1, s1) != 1)
+            return false;
+        result = r1 / s1;
+        return true;
+    }
+}
+
+// Solve the system modulo at most max_primes primes (using `threads` threads, 0: one per core) until the reconstructed solution is verified
+inline ExactSolution solve_exact(SparseRationalSystem const& system, size_t threads = 0, size_t max_primes = 100)
+{
+    using namespace exact_linear_solver;
+    using GiNaC::numeric;
+
+    if (threads == 0)
+        threads = hardware_threads();
+    size_t cols = system.cols + 1; // the last column is b
+
+    // Integer version of [A|b], by clearing denominators row by row; entries that fit in a long are reduced without touching GiNaC
+    std::vector< std::vector< std::pair<size_t, long> > > small_entries(system.rows.size());
+    std::vector< std::vector< std::pair<size_t, numeric> > > big_entries(system.rows.size());
+    numeric small_bound(std::numeric_limits<long>::max() / 2);
+    for (size_t r = 0; r != system.rows.size(); ++r)
+    {
+        numeric denominator = system.rhs[r].denom();
+        for (auto& entry : system.rows[r])
+            denominator = GiNaC::lcm(denominator, entry.second.denom());
+        auto add = [&](size_t col, numeric value) {
+            value *= denominator;
+            if (value.is_zero())
+                return;
+            if (GiNaC::abs(value) < small_bound)
+                small_entries[r].push_back({ col, value.to_long() });
+            else
+                big_entries[r].push_back({ col, value });
+        };
+        for (auto& entry : system.rows[r])
+            add(entry.first, entry.second);
+        add(system.cols, system.rhs[r]);
+    }
+
+    ExactSolution solution;
+    std::vector<size_t> best_pivots;
+    bool have_best = false;
+    std::vector< std::map<size_t, numeric> > accumulated; // echelon form modulo `modulus`, for the primes with the best pivots so far
+    numeric modulus = 1;
+    std::vector<numeric> previous_values; // reconstructed entries, to detect stabilization
+    bool have_previous = false;
+
+    for (size_t first_prime = 0; first_prime < max_primes; first_prime += threads)
+    {
+        size_t batch = std::min(threads, max_primes - first_prime);
+        std::vector<uint64_t> primes(batch);
+        std::vector< std::vector< std::vector<uint64_t> > > big_residues(batch, std::vector< std::vector<uint64_t> >(system.rows.size()));
+        for (size_t b = 0; b != batch; ++b)
+        {
+            primes[b] = nth_prime(first_prime + b);
+            numeric p(static_cast<long>(primes[b]));
+            for (size_t r = 0; r != system.rows.size(); ++r)
+                for (auto& entry : big_entries[r])
+                    big_residues[b][r].push_back(GiNaC::mod(entry.second, p).to_long());
+        }
+        std::vector<ModularEchelon> echelons(batch);
+        parallel_for(batch, threads, [&](size_t b) {
+            uint64_t p = primes[b];
+            std::vector<ModularRow> matrix(system.rows.size());
+            for (size_t r = 0; r != system.rows.size(); ++r)
+            {
+                for (auto& entry : small_entries[r])
+                {
+                    long residue = entry.second % static_cast<long>(p);
+                    if (residue != 0)
+                        matrix[r].push_back({ entry.first, static_cast<uint64_t>(residue < 0 ? residue + p : residue) });
+                }
+                for (size_t idx = 0; idx != big_entries[r].size(); ++idx)
+                    if (big_residues[b][r][idx] != 0)
+                        matrix[r].push_back({ big_entries[r][idx].first, big_residues[b][r][idx] });
+                std::sort(matrix[r].begin(), matrix[r].end());
+            }
+            echelons[b] = rref(matrix, cols, p);
+        });
+
+        for (size_t b = 0; b != batch; ++b)
+        {
+            ++solution.primes;
+            ModularEchelon& echelon = echelons[b];
+            // The pivots over the rationals have maximal rank, and are lexicographically smallest among those; other primes are unlucky
+            if (have_best && (echelon.pivots.size() < best_pivots.size() || (echelon.pivots.size() == best_pivots.size() && best_pivots < echelon.pivots)))
+                continue;
+            if (!have_best || echelon.pivots != best_pivots)
+            {
+                have_best = true;
+                best_pivots = echelon.pivots;
+                accumulated.assign(best_pivots.size(), std::map<size_t, numeric>());
+                modulus = 1;
+                have_previous = false;
+            }
+
+            // Chinese remainder theorem: x = x + modulus * ((residue - x) / modulus mod p)
+            uint64_t p = primes[b];
+            numeric p_numeric(static_cast<long>(p));
+            uint64_t modulus_inverse = inverse_mod(GiNaC::mod(modulus, p_numeric).to_long(), p);
+            for (size_t i = 0; i != accumulated.size(); ++i)
+            {
+                std::map<size_t, uint64_t> residues(echelon.rows[i].begin(), echelon.rows[i].end());
+                for (auto& entry : accumulated[i])
+                    residues.insert({ entry.first, 0 });
+                for (auto& entry : residues)
+                {
+                    numeric& x = accumulated[i][entry.first];
+                    uint64_t x_mod_p = GiNaC::mod(x, p_numeric).to_long();
+                    uint64_t t = (entry.second + p - x_mod_p) % p * modulus_inverse % p;
+                    x = x + modulus * numeric(static_cast<long>(t));
+                }
+            }
+            modulus = modulus * p_numeric;
+
+            // Rational reconstruction
+            std::vector<numeric> values;
+            bool reconstructed = true;
+            for (size_t i = 0; i != accumulated.size() && reconstructed; ++i)
+                for (auto& entry : accumulated[i])
+                {
+                    numeric value;
+                    if (!(reconstructed = rational_reconstruction(entry.second, modulus, value)))
+                        break;
+                    values.push_back(value);
+                }
+            if (!reconstructed)
+            {
+                have_previous = false;
+                continue;
+            }
+            bool stable = have_previous && values == previous_values;
+            previous_values = values;
+            have_previous = true;
+            if (!stable)
+                continue;
+
+            // Candidate solution
+            bool consistent = best_pivots.empty() || best_pivots.back() != system.cols;
+            size_t rank = best_pivots.size() - (consistent ? 0 : 1);
+            std::vector<bool> is_pivot(system.cols, false);
+            for (size_t i = 0; i != rank; ++i)
+                is_pivot[best_pivots[i]] = true;
+            std::vector<size_t> free_index(system.cols, 0);
+            std::vector<size_t> free_columns;
+            for (size_t col = 0; col != system.cols; ++col)
+                if (!is_pivot[col])
+                {
+                    free_index[col] = free_columns.size();
+                    free_columns.push_back(col);
+                }
+            std::vector< std::vector< std::pair<size_t, numeric> > > echelon_rows(rank);
+            std::vector<numeric> particular(system.cols, 0);
+            size_t value_idx = 0;
+            for (size_t i = 0; i != accumulated.size(); ++i)
+                for (auto& entry : accumulated[i])
+                {
+                    numeric const& value = values[value_idx++];
+                    if (i >= rank || value.is_zero())
+                        continue;
+                    if (entry.first == system.cols)
+                        particular[best_pivots[i]] = value;
+                    else
+                        echelon_rows[i].push_back({ entry.first, value });
+                }
+            std::vector<size_t> pivot_index(system.cols, 0);
+            for (size_t i = 0; i != rank; ++i)
+                pivot_index[best_pivots[i]] = i;
+
+            // Verification: A n = 0 for each kernel vector n, and A x = b for the particular solution
+            bool verified = true;
+            for (size_t r = 0; r != system.rows.size() && verified; ++r)
+            {
+                std::map<size_t, numeric> products; // free column -> (A n)_r
+                numeric product = 0; // (A x)_r
+                for (auto& entry : system.rows[r])
+                {
+                    if (!is_pivot[entry.first])
+                    {
+                        products[free_index[entry.first]] += entry.second;
+                        continue;
+                    }
+                    product += entry.second * particular[entry.first];
+                    for (auto& echelon_entry : echelon_rows[pivot_index[entry.first]])
+                        products[free_index[echelon_entry.first]] -= entry.second * echelon_entry.second;
+                }
+                if (consistent && product != system.rhs[r])
+                    verified = false;
+                for (auto& entry : products)
+                    if (!entry.second.is_zero())
+                        verified = false;
+            }
+            if (!verified)
+                continue;
+
+            solution.certified = true;
+            solution.consistent = consistent;
+            solution.rank = rank;
+            solution.pivots.assign(best_pivots.begin(), best_pivots.begin() + rank);
+            if (consistent)
+                solution.particular = particular;
+            solution.free_columns = free_columns;
+            solution.nullspace.assign(free_columns.size(), ExactSolution::SparseVector());
+            for (size_t f = 0; f != free_columns.size(); ++f)
+                solution.nullspace[f].push_back({ free_columns[f], 1 });
+            for (size_t i = 0; i != rank; ++i)
+                for (auto& entry : echelon_rows[i])
+                    solution.nullspace[free_index[entry.first]].push_back({ best_pivots[i], -entry.second });
+            for (auto& vector : solution.nullspace)
+                std::sort(vector.begin(), vector.end(), [](std::pair<size_t, numeric> const& a, std::pair<size_t, numeric> const& b) { return a.first < b.first; });
+            return solution;
+        }
+    }
+    return solution;
+}
+
+// The general solution as substitutions x == value (with the free unknowns as parameters), omitting the free unknowns themselves
+inline GiNaC::lst solution_substitutions(ExactSolution const& solution, std::vector<GiNaC::symbol> const& unknowns)
+{
+    std::vector<GiNaC::ex> values(unknowns.size());
+    for (size_t pivot : solution.pivots)
+        values[pivot] = solution.particular[pivot];
+    for (size_t f = 0; f != solution.free_columns.size(); ++f)
+        for (auto& entry : solution.nullspace[f])
+            if (entry.first != solution.free_columns[f])
+                values[entry.first] += entry.second * unknowns[solution.free_columns[f]];
+    GiNaC::lst substitutions;
+    for (size_t pivot : solution.pivots)
+        substitutions.append(unknowns[pivot] == values[pivot]);
+    return substitutions;
+}
+
+#endif
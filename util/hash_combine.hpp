@@ -0,0 +1,12 @@
+#ifndef INCLUDED_HASH_COMBINE_H_
+#define INCLUDED_HASH_COMBINE_H_
+
+#include <cstddef>
+
+// Mix value into seed (as boost::hash_combine does)
+inline void hash_combine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+#endif
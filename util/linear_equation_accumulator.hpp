@@ -0,0 +1,140 @@
+#ifndef INCLUDED_LINEAR_EQUATION_ACCUMULATOR_H_
+#define INCLUDED_LINEAR_EQUATION_ACCUMULATOR_H_
+
+#include "linear_system_assembler.hpp"
+#include "hash_combine.hpp"
+#include <ginac/ginac.h>
+#include <unordered_set>
+#include <set>
+#include <map>
+#include <vector>
+#include <limits>
+
+// Online version of a linear system: equations are added one at a time, and only those that are not implied by the previous ones are kept.
+// Each equation is scaled so that its first nonzero entry (of [A | b]) is 1; exact repetitions of such canonical forms are recognized by hashing,
+// the others are reduced against an echelon basis of the rows kept so far. Equations that are not linear in the unknowns are kept aside.
+class LinearEquationAccumulator
+{
+    struct CanonicalRow
+    {
+        SparseRationalSystem::Row row;
+        GiNaC::numeric rhs;
+
+        bool operator==(CanonicalRow const& other) const
+        {
+            if (row.size() != other.row.size() || rhs != other.rhs)
+                return false;
+            for (size_t idx = 0; idx != row.size(); ++idx)
+                if (row[idx].first != other.row[idx].first || row[idx].second != other.row[idx].second)
+                    return false;
+            return true;
+        }
+    };
+
+    struct CanonicalRowHash
+    {
+        size_t operator()(CanonicalRow const& canonical) const
+        {
+            size_t seed = GiNaC::ex(canonical.rhs).gethash();
+            for (auto& entry : canonical.row)
+            {
+                hash_combine(seed, entry.first);
+                hash_combine(seed, GiNaC::ex(entry.second).gethash());
+            }
+            return seed;
+        }
+    };
+
+    LinearSystemColumns d_columns;
+    SparseRationalSystem d_system; // the rows kept, with leading entry 1
+    std::vector<size_t> d_pivot_rows; // column (or d_system.cols, for b) -> index into d_system.rows
+    std::unordered_set<CanonicalRow, CanonicalRowHash> d_seen;
+    size_t d_seen_capacity;
+    std::set<GiNaC::ex, GiNaC::ex_is_less> d_nonlinear;
+
+    static const size_t none = std::numeric_limits<size_t>::max();
+
+    public:
+    // At most seen_capacity canonical forms are remembered (the memory is released when it is reached)
+    LinearEquationAccumulator(std::vector<GiNaC::symbol> const& unknowns, size_t seen_capacity = 1 << 16)
+    : d_pivot_rows(unknowns.size() + 1, std::numeric_limits<size_t>::max()), d_seen_capacity(seen_capacity)
+    {
+        for (size_t col = 0; col != unknowns.size(); ++col)
+            d_columns[unknowns[col]] = col;
+        d_system.cols = unknowns.size();
+    }
+
+    // Returns true if the equation is kept: linear and not implied by the previous ones, or non-linear and new
+    bool add(GiNaC::ex const& equation)
+    {
+        using GiNaC::numeric;
+        CanonicalRow canonical;
+        try {
+            linear_equation_row(equation, d_columns, canonical.row, canonical.rhs);
+        }
+        catch (std::invalid_argument const&)
+        {
+            return d_nonlinear.insert(equation).second;
+        }
+        numeric leading = canonical.row.empty() ? canonical.rhs : canonical.row.front().second;
+        if (leading.is_zero()) // 0 == 0
+            return false;
+        for (auto& entry : canonical.row)
+            entry.second = entry.second / leading;
+        canonical.rhs = canonical.rhs / leading;
+        if (d_seen.size() == d_seen_capacity)
+            d_seen = std::unordered_set<CanonicalRow, CanonicalRowHash>();
+        if (!d_seen.insert(canonical).second)
+            return false;
+
+        // Reduce the leading entry against the basis, until it is not a pivot
+        std::map<size_t, numeric> row(canonical.row.begin(), canonical.row.end());
+        if (!canonical.rhs.is_zero())
+            row[d_system.cols] = canonical.rhs;
+        while (!row.empty() && d_pivot_rows[row.begin()->first] != none)
+        {
+            size_t pivot_row = d_pivot_rows[row.begin()->first];
+            numeric factor = row.begin()->second;
+            row.erase(row.begin());
+            for (auto& entry : d_system.rows[pivot_row])
+                if (entry.first != d_system.rows[pivot_row].front().first)
+                {
+                    numeric& value = row[entry.first];
+                    value -= factor * entry.second;
+                    if (value.is_zero())
+                        row.erase(entry.first);
+                }
+            if (!d_system.rhs[pivot_row].is_zero())
+            {
+                numeric& value = row[d_system.cols];
+                value -= factor * d_system.rhs[pivot_row];
+                if (value.is_zero())
+                    row.erase(d_system.cols);
+            }
+        }
+        if (row.empty())
+            return false;
+
+        // A new pivot (in column d_system.cols if the system became inconsistent)
+        numeric scale = row.begin()->second;
+        SparseRationalSystem::Row kept;
+        numeric rhs = 0;
+        for (auto& entry : row)
+        {
+            if (entry.first == d_system.cols)
+                rhs = entry.second / scale;
+            else
+                kept.push_back({ entry.first, entry.second / scale });
+        }
+        d_pivot_rows[row.begin()->first] = d_system.rows.size();
+        d_system.add_row(kept, rhs);
+        return true;
+    }
+
+    size_t rank() const { return d_system.rows.size(); } // of [A | b]
+    bool consistent() const { return d_pivot_rows[d_system.cols] == none; }
+    SparseRationalSystem const& system() const { return d_system; } // in echelon form (up to the order of the rows)
+    std::set<GiNaC::ex, GiNaC::ex_is_less> const& nonlinear() const { return d_nonlinear; }
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef INCLUDED_LINEAR_SYSTEM_ASSEMBLER_H_
+#define INCLUDED_LINEAR_SYSTEM_ASSEMBLER_H_
+
+#include "exact_linear_solver.hpp"
+#include <ginac/ginac.h>
+#include <unordered_map>
+#include <vector>
+#include <map>
+#include <string>
+#include <ostream>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+
+typedef std::unordered_map<GiNaC::ex, size_t, GiNaC::ex_hash, GiNaC::ex_is_equal> LinearSystemColumns;
+
+// Takes an equation (expression == 0, or relation) that is linear in the unknowns (with rational coefficients) apart into a sparse row, sorted by column,
+// and a right-hand side; throws std::invalid_argument if it is not linear
+inline void linear_equation_row(GiNaC::ex equation, LinearSystemColumns const& columns, SparseRationalSystem::Row& sparse_row, GiNaC::numeric& rhs)
+{
+    using namespace GiNaC;
+    if (is_a<relational>(equation))
+        equation = equation.lhs() - equation.rhs();
+    equation = equation.expand();
+    std::map<size_t, numeric> row;
+    numeric constant = 0;
+    auto add_term = [&](ex const& term) {
+        numeric prefactor = 1;
+        size_t column = 0;
+        bool has_unknown = false;
+        auto add_factor = [&](ex const& factor) {
+            if (is_a<numeric>(factor) && ex_to<numeric>(factor).is_rational())
+            {
+                prefactor *= ex_to<numeric>(factor);
+                return;
+            }
+            auto position = columns.find(factor);
+            if (has_unknown || position == columns.end())
+                throw std::invalid_argument("equation is not linear in the unknowns");
+            column = position->second;
+            has_unknown = true;
+        };
+        if (is_a<mul>(term))
+            for (ex const& factor : term)
+                add_factor(factor);
+        else
+            add_factor(term);
+        if (has_unknown)
+            row[column] += prefactor;
+        else
+            constant += prefactor;
+    };
+    if (is_a<add>(equation))
+        for (ex const& term : equation)
+            add_term(term);
+    else if (!equation.is_zero())
+        add_term(equation);
+    sparse_row.clear();
+    for (auto& entry : row)
+        if (!entry.second.is_zero())
+            sparse_row.push_back(entry);
+    rhs = -constant;
+}
+
+// Assembles a sparse linear system from equations (expressions == 0) that are linear in the given unknowns, row by row.
+// Unknowns are mapped to columns by a hash table; each term of an equation is taken apart only once.
+//
+// Output formats, both of the augmented matrix [A | b] of A x = b with every row scaled to integers (column `cols` is b):
+// - MatrixMarket: "coordinate integer general", 1-based, with the names of the unknowns in comment lines;
+// - binary (host byte order): "KGLINSYS", uint64 rows, cols, nonzeros, then for each unknown a uint64 length and its name,
+//   then for each nonzero a uint64 row, uint64 column and int64 value (0-based).
+class LinearSystemAssembler
+{
+    LinearSystemColumns d_columns;
+    std::vector<GiNaC::symbol> d_unknowns;
+    SparseRationalSystem d_system;
+    size_t d_nonzeros = 0; // in [A | b]
+
+    // Row r of [A | b], scaled to integers
+    std::vector< std::pair<size_t, GiNaC::numeric> > integer_row(size_t r) const
+    {
+        GiNaC::numeric denominator = d_system.rhs[r].denom();
+        for (auto& entry : d_system.rows[r])
+            denominator = GiNaC::lcm(denominator, entry.second.denom());
+        std::vector< std::pair<size_t, GiNaC::numeric> > row;
+        for (auto& entry : d_system.rows[r])
+            row.push_back({ entry.first, entry.second * denominator });
+        if (!d_system.rhs[r].is_zero())
+            row.push_back({ d_system.cols, d_system.rhs[r] * denominator });
+        return row;
+    }
+
+    public:
+    LinearSystemAssembler(std::vector<GiNaC::symbol> const& unknowns)
+    : d_unknowns(unknowns)
+    {
+        for (size_t col = 0; col != unknowns.size(); ++col)
+            d_columns[unknowns[col]] = col;
+        d_system.cols = unknowns.size();
+    }
+
+    // Throws std::invalid_argument if the equation is not linear in the unknowns (with rational coefficients)
+    void add_equation(GiNaC::ex const& equation)
+    {
+        SparseRationalSystem::Row row;
+        GiNaC::numeric rhs;
+        linear_equation_row(equation, d_columns, row, rhs);
+        d_nonzeros += row.size() + (rhs.is_zero() ? 0 : 1);
+        d_system.add_row(row, rhs);
+    }
+
+    // A row taken apart before (by linear_equation_row, with the columns() of this assembler)
+    void add_row(SparseRationalSystem::Row const& row, GiNaC::numeric const& rhs)
+    {
+        d_nonzeros += row.size() + (rhs.is_zero() ? 0 : 1);
+        d_system.add_row(row, rhs);
+    }
+
+    // One equation per term: its coefficient (e.g. of a reduced KontsevichGraphSum<ex>)
+    template<class Terms>
+    void add_coefficient_equations(Terms const& terms)
+    {
+        for (auto& term : terms)
+            add_equation(term.first);
+    }
+
+    size_t rows() const { return d_system.rows.size(); }
+    size_t cols() const { return d_system.cols; }
+    size_t nonzeros() const { return d_nonzeros; }
+    std::vector<GiNaC::symbol> const& unknowns() const { return d_unknowns; }
+    LinearSystemColumns const& columns() const { return d_columns; }
+    SparseRationalSystem const& system() const { return d_system; }
+
+    void write_matrix_market(std::ostream& os) const
+    {
+        os << "%%MatrixMarket matrix coordinate integer general\n"
+           << "% augmented matrix [A | b] of A x = b, rows scaled to integers; column " << cols() + 1 << " is b\n";
+        for (size_t col = 0; col != cols(); ++col)
+            os << "% column " << col + 1 << ": " << d_unknowns[col].get_name() << "\n";
+        os << rows() << " " << cols() + 1 << " " << nonzeros() << "\n";
+        for (size_t r = 0; r != rows(); ++r)
+            for (auto& entry : integer_row(r))
+                os << r + 1 << " " << entry.first + 1 << " " << GiNaC::ex(entry.second) << "\n";
+    }
+
+    // Throws std::overflow_error if a scaled entry does not fit in 64 bits
+    void write_binary(std::ostream& os) const
+    {
+        auto write_uint64 = [&os](uint64_t value) { os.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+        os.write("KGLINSYS", 8);
+        write_uint64(rows());
+        write_uint64(cols());
+        write_uint64(nonzeros());
+        for (auto& unknown : d_unknowns)
+        {
+            std::string name = unknown.get_name();
+            write_uint64(name.size());
+            os.write(name.data(), name.size());
+        }
+        GiNaC::numeric bound(std::numeric_limits<long>::max());
+        for (size_t r = 0; r != rows(); ++r)
+            for (auto& entry : integer_row(r))
+            {
+                if (!(GiNaC::abs(entry.second) < bound))
+                    throw std::overflow_error("LinearSystemAssembler: entry does not fit in 64 bits");
+                int64_t value = entry.second.to_long();
+                write_uint64(r);
+                write_uint64(entry.first);
+                os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+    }
+};
+
+// The linear system given by expressions (== 0) or relations in the unknowns; throws std::invalid_argument if an equation is not linear
+inline SparseRationalSystem linear_system(std::vector<GiNaC::ex> const& equations, std::vector<GiNaC::symbol> const& unknowns)
+{
+    LinearSystemAssembler assembler(unknowns);
+    for (auto& equation : equations)
+        assembler.add_equation(equation);
+    return assembler.system();
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef INCLUDED_MAPPED_FILE_H_
+#define INCLUDED_MAPPED_FILE_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Read-only memory map of a whole file. A file that cannot be opened behaves like an empty file.
+class MappedFile
+{
+    const char* d_data = nullptr;
+    size_t d_size = 0;
+    bool d_open = false;
+
+    public:
+    typedef std::pair<const char*, const char*> Range;
+
+    MappedFile(std::string const& filename)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0)
+        {
+            d_open = true;
+            d_size = info.st_size;
+            if (d_size != 0)
+            {
+                void* data = mmap(nullptr, d_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED)
+                {
+                    d_open = false;
+                    d_size = 0;
+                }
+                else
+                {
+                    d_data = static_cast<const char*>(data);
+                    madvise(data, d_size, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (d_data != nullptr)
+            munmap(const_cast<char*>(d_data), d_size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const
+    {
+        return d_open;
+    }
+
+    const char* data() const
+    {
+        return d_data;
+    }
+
+    size_t size() const
+    {
+        return d_size;
+    }
+
+    // Split the file into (at most) `count` ranges of roughly equal size, each ending just after a newline (or at the end of the file)
+    std::vector<Range> chunks(size_t count) const
+    {
+        std::vector<Range> result;
+        if (count == 0)
+            count = 1;
+        const char* begin = d_data;
+        const char* end = d_data + d_size;
+        for (size_t c = 1; c <= count && begin != end; ++c)
+        {
+            const char* boundary = (c == count) ? end : d_data + d_size / count * c;
+            if (boundary < begin)
+                boundary = begin;
+            if (boundary != end)
+            {
+                const char* newline = static_cast<const char*>(memchr(boundary, '\n', end - boundary));
+                boundary = (newline == nullptr) ? end : newline + 1;
+            }
+            if (boundary != begin)
+                result.push_back({ begin, boundary });
+            begin = boundary;
+        }
+        return result;
+    }
+};
+
+// Call fun(line) for each line in the range, without the trailing newline (as std::getline would)
+template <class Function>
+void for_each_line(MappedFile::Range range, Function fun)
+{
+    const char* begin = range.first;
+    while (begin != range.second)
+    {
+        const char* newline = static_cast<const char*>(memchr(begin, '\n', range.second - begin));
+        const char* end = (newline == nullptr) ? range.second : newline;
+        fun(std::string(begin, end));
+        begin = (newline == nullptr) ? range.second : newline + 1;
+    }
+}
+
+#endif
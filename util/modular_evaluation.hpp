@@ -0,0 +1,112 @@
+#ifndef INCLUDED_MODULAR_EVALUATION_H_
+#define INCLUDED_MODULAR_EVALUATION_H_
+
+#include "sparse_polynomial.hpp"
+#include "poisson_structure_evaluator.hpp" // for NumericTraits, PointBatch
+#include "exact_linear_solver.hpp" // for inverse_mod
+#include <ginac/ginac.h>
+#include <cln/cln.h>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdint>
+
+// Residues modulo the prime 2^31 - 1 (so that products fit in 64 bits)
+class Modular
+{
+    uint64_t d_residue = 0;
+
+    public:
+    static const uint64_t prime = (1ULL << 31) - 1;
+
+    Modular(int value = 0)
+    : d_residue(((int64_t)value % (int64_t)prime + (int64_t)prime) % prime)
+    {}
+
+    static Modular from_residue(uint64_t residue)
+    {
+        Modular result;
+        result.d_residue = residue % prime;
+        return result;
+    }
+
+    // Throws std::invalid_argument if the denominator is divisible by the prime
+    static Modular from_rational(cln::cl_RA const& value)
+    {
+        GiNaC::numeric rational(value), modulus((long)prime);
+        uint64_t denominator = GiNaC::mod(rational.denom(), modulus).to_long();
+        if (denominator == 0)
+            throw std::invalid_argument("Modular: denominator divisible by the prime");
+        return from_residue(GiNaC::mod(rational.numer(), modulus).to_long()) *= from_residue(exact_linear_solver::inverse_mod(denominator, prime));
+    }
+
+    uint64_t residue() const { return d_residue; }
+
+    Modular& operator+=(Modular const& other)
+    {
+        d_residue = (d_residue + other.d_residue) % prime;
+        return *this;
+    }
+
+    Modular& operator*=(Modular const& other)
+    {
+        d_residue = d_residue * other.d_residue % prime;
+        return *this;
+    }
+
+    Modular operator-() const { return from_residue(prime - d_residue); }
+};
+
+template<>
+struct NumericTraits<Modular>
+{
+    static bool is_zero(Modular const& value) { return value.residue() == 0; }
+};
+
+// The value of a polynomial with rational coefficients modulo the prime, at a batch of points (the residues of its variables)
+inline PointBatch<Modular> modular_value(SparsePolynomial<cln::cl_RA> const& polynomial, std::vector< std::vector<Modular> > const& points)
+{
+    MonomialPacking const& packing = polynomial.packing();
+    std::vector<Modular> values(points.size());
+    for (auto& term : polynomial.terms())
+    {
+        Modular coefficient = Modular::from_rational(term.second);
+        for (size_t k = 0; k != points.size(); ++k)
+        {
+            Modular value = coefficient;
+            for (size_t var = 0; var != packing.variables(); ++var)
+                for (uint64_t e = packing.exponent(term.first, var); e != 0; --e)
+                    value *= points[k][var];
+            values[k] += value;
+        }
+    }
+    return PointBatch<Modular>(values);
+}
+
+// The bivector components of a polynomial Poisson structure and their derivatives, evaluated modulo the prime at a batch of points:
+// residues of the coordinates and the parameters, in the order of PolynomialPoissonStructure::variables()
+class ModularPoissonStructureEvaluator
+{
+    PolynomialPoissonStructure& d_polynomial;
+    std::vector< std::vector<Modular> > d_points;
+    std::unordered_map<BivectorDerivativeKey, PointBatch<Modular>, BivectorDerivativeKeyHash> d_values;
+
+    public:
+    ModularPoissonStructureEvaluator(PolynomialPoissonStructure& polynomial, std::vector< std::vector<Modular> > const& points)
+    : d_polynomial(polynomial), d_points(points)
+    {}
+
+    PoissonStructure& poisson() { return d_polynomial.poisson(); }
+    std::vector< std::vector<Modular> > const& points() const { return d_points; }
+
+    // Throws std::invalid_argument if a coefficient has a denominator divisible by the prime
+    PointBatch<Modular> const& bivector_derivative(BivectorDerivativeKey const& key)
+    {
+        auto value = d_values.find(key);
+        if (value != d_values.end())
+            return value->second;
+        return d_values.insert({ key, modular_value(d_polynomial.bivector_derivative(key), d_points) }).first->second;
+    }
+};
+
+#endif
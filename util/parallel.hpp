@@ -0,0 +1,60 @@
+#ifndef INCLUDED_PARALLEL_H_
+#define INCLUDED_PARALLEL_H_
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <functional>
+
+inline size_t hardware_threads()
+{
+    size_t threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+// Calls fun(chunk) for chunk = 0, ..., chunks - 1 on at most `threads` threads (0 means one per core).
+// Chunks are handed out in increasing order; the first exception thrown by fun is rethrown here.
+inline void parallel_for(size_t chunks, size_t threads, std::function<void(size_t)> const& fun)
+{
+    if (threads == 0)
+        threads = hardware_threads();
+    if (threads > chunks)
+        threads = chunks;
+    if (threads <= 1)
+    {
+        for (size_t chunk = 0; chunk != chunks; ++chunk)
+            fun(chunk);
+        return;
+    }
+    std::atomic<size_t> next_chunk(0);
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (size_t t = 0; t != threads; ++t)
+    {
+        workers.push_back(std::thread([&]() {
+            for (size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++)
+            {
+                try {
+                    fun(chunk);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error)
+                        error = std::current_exception();
+                    next_chunk = chunks; // stop handing out work
+                }
+            }
+        }));
+    }
+    for (auto& worker : workers)
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+#endif
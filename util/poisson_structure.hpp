@@ -3,10 +3,84 @@
 
 #include <vector>
 #include <map>
+#include <set>
+#include <array>
+#include <unordered_map>
+#include <functional>
+#include <string>
+#include <sstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
 #include <ginac/ginac.h>
+#include "hash_combine.hpp"
 
 typedef std::multiset<size_t> multi_index;
 
+// Packed key of a derivative of a bivector component: the component indices i, j, the number of derivatives,
+// and the coordinate indices of the derivatives in increasing order, one byte each
+class BivectorDerivativeKey
+{
+    std::array<uint8_t, 16> d_bytes;
+
+    public:
+    static const size_t max_derivatives = 13;
+
+    // Throws std::length_error if an index does not fit in a byte
+    BivectorDerivativeKey(size_t i, size_t j)
+    : d_bytes()
+    {
+        if (i > 255 || j > 255)
+            throw std::length_error("BivectorDerivativeKey: index out of range");
+        d_bytes[0] = i;
+        d_bytes[1] = j;
+    }
+
+    size_t i() const { return d_bytes[0]; }
+    size_t j() const { return d_bytes[1]; }
+    size_t derivatives() const { return d_bytes[2]; }
+    size_t derivative(size_t idx) const { return d_bytes[3 + idx]; }
+
+    // Throws std::length_error if there are already max_derivatives derivatives (or the index does not fit in a byte)
+    void add_derivative(size_t l)
+    {
+        if (derivatives() == max_derivatives || l > 255)
+            throw std::length_error("BivectorDerivativeKey: too many derivatives");
+        size_t idx = 3 + d_bytes[2]++;
+        for (; idx != 3 && d_bytes[idx - 1] > l; --idx)
+            d_bytes[idx] = d_bytes[idx - 1];
+        d_bytes[idx] = l;
+    }
+
+    // The same derivative, without the derivative by the coordinate with the largest index
+    BivectorDerivativeKey without_last() const
+    {
+        BivectorDerivativeKey key(*this);
+        key.d_bytes[2 + key.d_bytes[2]] = 0;
+        --key.d_bytes[2];
+        return key;
+    }
+
+    bool operator==(BivectorDerivativeKey const& other) const { return d_bytes == other.d_bytes; }
+
+    size_t hash() const
+    {
+        uint64_t words[2];
+        std::memcpy(words, d_bytes.data(), sizeof(words));
+        size_t seed = 0;
+        hash_combine(seed, words[0]);
+        hash_combine(seed, words[1]);
+        return seed;
+    }
+};
+
+struct BivectorDerivativeKeyHash
+{
+    size_t operator()(BivectorDerivativeKey const& key) const { return key.hash(); }
+};
+
 struct PoissonStructure
 {
     std::vector<GiNaC::symbol> coordinates;
@@ -14,7 +88,119 @@ struct PoissonStructure
     // used in poisson_make_vanish:
     enum class Type { Generic, Polynomial, Particular };
     Type type;
-    std::map< std::pair< std::pair<size_t, size_t>, multi_index >, GiNaC::ex> bivector_derivatives_cache;
+    // caches, filled on first use (initialize them with {} in aggregate initializers)
+    std::unordered_map<BivectorDerivativeKey, GiNaC::ex, BivectorDerivativeKeyHash> bivector_derivatives_cache;
+    std::vector< std::vector< std::vector<bool> > > bivector_dependencies; // [i][j][l]: whether bivector[i][j] depends on coordinates[l] (filled on first use)
+
+    // The derivative of bivector[key.i()][key.j()], computed (from the derivative of one order lower) and cached on first use
+    GiNaC::ex const& bivector_derivative(BivectorDerivativeKey const& key)
+    {
+        auto cached = bivector_derivatives_cache.find(key);
+        if (cached != bivector_derivatives_cache.end())
+            return cached->second;
+        GiNaC::ex derivative = (key.derivatives() == 0) ? bivector[key.i()][key.j()]
+                             : bivector_derivative(key.without_last()).diff(coordinates[key.derivative(key.derivatives() - 1)]);
+        return bivector_derivatives_cache.insert({ key, derivative }).first->second;
+    }
+
+    // Computes all derivatives of the components up to the given order (apart from derivatives of derivatives that vanish)
+    void precompute_bivector_derivatives(size_t max_order)
+    {
+        std::function<void(BivectorDerivativeKey const&, size_t)> extend = [&](BivectorDerivativeKey const& key, size_t first) {
+            if (bivector_derivative(key).is_zero() || key.derivatives() == max_order || key.derivatives() == BivectorDerivativeKey::max_derivatives)
+                return;
+            for (size_t l = first; l != coordinates.size(); ++l)
+            {
+                BivectorDerivativeKey next = key;
+                next.add_derivative(l);
+                extend(next, l);
+            }
+        };
+        for (size_t i = 0; i != coordinates.size(); ++i)
+            for (size_t j = 0; j != coordinates.size(); ++j)
+                extend(BivectorDerivativeKey(i, j), 0);
+    }
+
+    // The coordinates and the other symbols (parameters) in the components, e.g. for reading archives
+    GiNaC::lst symbols() const
+    {
+        std::set<GiNaC::ex, GiNaC::ex_is_less> found(coordinates.begin(), coordinates.end());
+        for (auto& row : bivector)
+            for (GiNaC::ex const& entry : row)
+                for (auto it = entry.preorder_begin(); it != entry.preorder_end(); ++it)
+                    if (GiNaC::is_a<GiNaC::symbol>(*it))
+                        found.insert(*it);
+        GiNaC::lst symbol_list;
+        for (GiNaC::ex const& symbol : found)
+            symbol_list.append(symbol);
+        return symbol_list;
+    }
+
+    // Writes the cached derivatives as a GiNaC archive, together with the components themselves (to recognize the structure)
+    void save_bivector_derivatives(std::ostream& os) const
+    {
+        GiNaC::archive derivatives_archive;
+        for (size_t i = 0; i != coordinates.size(); ++i)
+            for (size_t j = 0; j != coordinates.size(); ++j)
+                derivatives_archive.archive_ex(bivector[i][j], ("P " + std::to_string(i) + " " + std::to_string(j)).c_str());
+        for (auto& entry : bivector_derivatives_cache)
+        {
+            std::string name = "D " + std::to_string(entry.first.i()) + " " + std::to_string(entry.first.j());
+            for (size_t idx = 0; idx != entry.first.derivatives(); ++idx)
+                name += " " + std::to_string(entry.first.derivative(idx));
+            derivatives_archive.archive_ex(entry.second, name.c_str());
+        }
+        os << derivatives_archive;
+    }
+
+    // Adds the derivatives in an archive written by save_bivector_derivatives to the cache;
+    // returns false (and adds nothing) if the archive belongs to a different structure or cannot be read
+    bool load_bivector_derivatives(std::istream& is)
+    {
+        try {
+            GiNaC::archive derivatives_archive;
+            is >> derivatives_archive;
+            if (!is)
+                return false;
+            GiNaC::lst symbol_list = symbols();
+            std::vector< std::pair<BivectorDerivativeKey, GiNaC::ex> > derivatives;
+            size_t components = 0;
+            for (size_t idx = 0; idx != derivatives_archive.num_expressions(); ++idx)
+            {
+                std::string name;
+                GiNaC::ex expression = derivatives_archive.unarchive_ex(symbol_list, name, idx);
+                std::istringstream name_stream(name);
+                std::string kind;
+                size_t i, j, l;
+                name_stream >> kind >> i >> j;
+                if (!name_stream || i >= coordinates.size() || j >= coordinates.size())
+                    return false;
+                if (kind == "P")
+                {
+                    if (!expression.is_equal(bivector[i][j]))
+                        return false;
+                    ++components;
+                    continue;
+                }
+                BivectorDerivativeKey key(i, j);
+                while (name_stream >> l)
+                {
+                    if (l >= coordinates.size())
+                        return false;
+                    key.add_derivative(l);
+                }
+                derivatives.push_back({ key, expression });
+            }
+            if (components != coordinates.size() * coordinates.size())
+                return false;
+            bivector_derivatives_cache.insert(derivatives.begin(), derivatives.end());
+            return true;
+        }
+        catch (std::exception const&) // e.g. a truncated or foreign file
+        {
+            return false;
+        }
+    }
 };
 
 #endif
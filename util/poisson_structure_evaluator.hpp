@@ -0,0 +1,350 @@
+#ifndef INCLUDED_POISSON_STRUCTURE_EVALUATOR_H_
+#define INCLUDED_POISSON_STRUCTURE_EVALUATOR_H_
+
+#include "poisson_structure.hpp"
+#include <ginac/ginac.h>
+#include <cln/cln.h>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <stdexcept>
+
+// Conversions and operations for the number types of CompiledExpression: double, and exact rationals (cln::cl_RA)
+template<class T>
+struct NumericTraits;
+
+template<>
+struct NumericTraits<double>
+{
+    typedef double (*Function)(double const&);
+
+    static bool is_zero(double const& value) { return value == 0; }
+
+    static double from_numeric(GiNaC::numeric const& value)
+    {
+        if (!value.is_real())
+            throw std::invalid_argument("not a real number");
+        return value.to_double();
+    }
+
+    static double real_power(double const& base, double const& exponent) { return std::pow(base, exponent); }
+
+    static Function function(std::string const& name)
+    {
+        if (name == "sin") return [](double const& x) { return std::sin(x); };
+        if (name == "cos") return [](double const& x) { return std::cos(x); };
+        if (name == "tan") return [](double const& x) { return std::tan(x); };
+        if (name == "exp") return [](double const& x) { return std::exp(x); };
+        if (name == "log") return [](double const& x) { return std::log(x); };
+        if (name == "atan") return [](double const& x) { return std::atan(x); };
+        if (name == "abs") return [](double const& x) { return std::fabs(x); };
+        return nullptr;
+    }
+};
+
+template<>
+struct NumericTraits<cln::cl_RA>
+{
+    typedef cln::cl_RA (*Function)(cln::cl_RA const&);
+
+    static bool is_zero(cln::cl_RA const& value) { return cln::zerop(value); }
+
+    static cln::cl_RA from_numeric(GiNaC::numeric const& value)
+    {
+        if (!value.is_rational())
+            throw std::invalid_argument("not a rational number");
+        return cln::the<cln::cl_RA>(value.to_cl_N());
+    }
+
+    static cln::cl_RA real_power(cln::cl_RA const&, cln::cl_RA const&)
+    {
+        throw std::invalid_argument("non-integer power of a rational number");
+    }
+
+    static Function function(std::string const&) { return nullptr; }
+};
+
+// Values at a batch of points, with component-wise arithmetic (that the compiler can vectorize for double);
+// a value constructed from a single number is the same at all points
+template<class T>
+class PointBatch
+{
+    std::vector<T> d_values; // one per point, or a single one for all points
+
+    public:
+    PointBatch(int value = 0)
+    : d_values(1, T(value))
+    {}
+
+    explicit PointBatch(std::vector<T> const& values)
+    : d_values(values)
+    {}
+
+    size_t size() const { return d_values.size(); }
+    T const& operator[](size_t k) const { return d_values[d_values.size() == 1 ? 0 : k]; }
+
+    PointBatch& operator*=(PointBatch const& other)
+    {
+        if (d_values.size() == 1 && other.d_values.size() != 1)
+            d_values.resize(other.d_values.size(), d_values[0]);
+        if (other.d_values.size() == 1)
+            for (size_t k = 0; k != d_values.size(); ++k)
+                d_values[k] *= other.d_values[0];
+        else
+            for (size_t k = 0; k != d_values.size(); ++k)
+                d_values[k] *= other.d_values[k];
+        return *this;
+    }
+
+    PointBatch& operator+=(PointBatch const& other)
+    {
+        if (d_values.size() == 1 && other.d_values.size() != 1)
+            d_values.resize(other.d_values.size(), d_values[0]);
+        if (other.d_values.size() == 1)
+            for (size_t k = 0; k != d_values.size(); ++k)
+                d_values[k] += other.d_values[0];
+        else
+            for (size_t k = 0; k != d_values.size(); ++k)
+                d_values[k] += other.d_values[k];
+        return *this;
+    }
+
+    PointBatch operator-() const
+    {
+        PointBatch result(*this);
+        for (T& value : result.d_values)
+            value = -value;
+        return result;
+    }
+
+    bool is_zero() const
+    {
+        for (T const& value : d_values)
+            if (!NumericTraits<T>::is_zero(value))
+                return false;
+        return true;
+    }
+};
+
+template<class T>
+struct NumericTraits< PointBatch<T> >
+{
+    static bool is_zero(PointBatch<T> const& value) { return value.is_zero(); }
+};
+
+// A GiNaC expression in the coordinates, compiled into a straight-line program (with common subexpressions computed once),
+// to be evaluated at points with values of type T: double or cln::cl_RA.
+// Subexpressions without coordinates are evaluated once (numerically), powers with integer exponents are computed by repeated squaring.
+template<class T>
+class CompiledExpression
+{
+    enum class Operation { Constant, Coordinate, Add, Multiply, Power, RealPower, Function };
+    struct Instruction
+    {
+        Operation operation;
+        size_t first, second; // operands: registers (or constants, or coordinates)
+        long exponent;
+        typename NumericTraits<T>::Function function;
+    };
+
+    std::vector<Instruction> d_program; // instruction i writes register i
+    std::vector<T> d_constants;
+    size_t d_result;
+
+    size_t emit(Instruction instruction)
+    {
+        d_program.push_back(instruction);
+        return d_program.size() - 1;
+    }
+
+    size_t compile(GiNaC::ex const& expression, std::vector<GiNaC::symbol> const& coordinates,
+                   std::unordered_map<GiNaC::ex, size_t, GiNaC::ex_hash, GiNaC::ex_is_equal>& registers)
+    {
+        using namespace GiNaC;
+        auto known = registers.find(expression);
+        if (known != registers.end())
+            return known->second;
+        size_t result;
+        bool constant = true;
+        for (size_t idx = 0; idx != coordinates.size() && constant; ++idx)
+            constant = !expression.has(coordinates[idx]);
+        if (constant)
+        {
+            ex value = is_a<numeric>(expression) ? expression : expression.evalf();
+            if (!is_a<numeric>(value))
+                throw std::invalid_argument("CompiledExpression: cannot evaluate a subexpression without the coordinates to a number");
+            d_constants.push_back(NumericTraits<T>::from_numeric(ex_to<numeric>(value)));
+            result = emit({ Operation::Constant, d_constants.size() - 1, 0, 0, nullptr });
+        }
+        else if (is_a<symbol>(expression))
+        {
+            size_t idx = 0;
+            while (!expression.is_equal(coordinates[idx]))
+                ++idx;
+            result = emit({ Operation::Coordinate, idx, 0, 0, nullptr });
+        }
+        else if (is_a<add>(expression) || is_a<mul>(expression))
+        {
+            Operation operation = is_a<add>(expression) ? Operation::Add : Operation::Multiply;
+            result = compile(expression.op(0), coordinates, registers);
+            for (size_t idx = 1; idx != expression.nops(); ++idx)
+            {
+                size_t operand = compile(expression.op(idx), coordinates, registers);
+                result = emit({ operation, result, operand, 0, nullptr });
+            }
+        }
+        else if (is_a<power>(expression))
+        {
+            size_t base = compile(expression.op(0), coordinates, registers);
+            ex exponent = expression.op(1);
+            if (is_a<numeric>(exponent) && ex_to<numeric>(exponent).is_integer())
+                result = emit({ Operation::Power, base, 0, ex_to<numeric>(exponent).to_long(), nullptr });
+            else
+                result = emit({ Operation::RealPower, base, compile(exponent, coordinates, registers), 0, nullptr });
+        }
+        else if (is_a<function>(expression) && expression.nops() == 1)
+        {
+            auto function = NumericTraits<T>::function(ex_to<GiNaC::function>(expression).get_name());
+            if (function == nullptr)
+                throw std::invalid_argument("CompiledExpression: cannot evaluate the function " + ex_to<GiNaC::function>(expression).get_name());
+            result = emit({ Operation::Function, compile(expression.op(0), coordinates, registers), 0, 0, function });
+        }
+        else
+            throw std::invalid_argument("CompiledExpression: cannot evaluate an expression of this kind");
+        registers[expression] = result;
+        return result;
+    }
+
+    static T integer_power(T base, long exponent)
+    {
+        bool invert = exponent < 0;
+        unsigned long remaining = invert ? -exponent : exponent;
+        T result = 1;
+        while (remaining)
+        {
+            if (remaining & 1)
+                result *= base;
+            remaining >>= 1;
+            if (remaining)
+                base *= base;
+        }
+        return invert ? T(1) / result : result;
+    }
+
+    public:
+    // Throws std::invalid_argument if the expression cannot be evaluated in T (e.g. a function without a numeric implementation)
+    CompiledExpression(GiNaC::ex const& expression, std::vector<GiNaC::symbol> const& coordinates)
+    {
+        std::unordered_map<GiNaC::ex, size_t, GiNaC::ex_hash, GiNaC::ex_is_equal> registers;
+        d_result = compile(expression, coordinates, registers);
+    }
+
+    size_t size() const { return d_program.size(); }
+
+    T operator()(std::vector<T> const& point) const
+    {
+        std::vector<T> registers(d_program.size());
+        for (size_t idx = 0; idx != d_program.size(); ++idx)
+        {
+            Instruction const& instruction = d_program[idx];
+            switch (instruction.operation)
+            {
+                case Operation::Constant:
+                    registers[idx] = d_constants[instruction.first];
+                    break;
+                case Operation::Coordinate:
+                    registers[idx] = point[instruction.first];
+                    break;
+                case Operation::Add:
+                    registers[idx] = registers[instruction.first] + registers[instruction.second];
+                    break;
+                case Operation::Multiply:
+                    registers[idx] = registers[instruction.first] * registers[instruction.second];
+                    break;
+                case Operation::Power:
+                    registers[idx] = integer_power(registers[instruction.first], instruction.exponent);
+                    break;
+                case Operation::RealPower:
+                    registers[idx] = NumericTraits<T>::real_power(registers[instruction.first], registers[instruction.second]);
+                    break;
+                case Operation::Function:
+                    registers[idx] = instruction.function(registers[instruction.first]);
+                    break;
+            }
+        }
+        return registers[d_result];
+    }
+};
+
+// The values of the bivector components (and their derivatives) of a Poisson structure at a point, in T (double or cln::cl_RA).
+// Each derivative is compiled on first use (and kept when the point changes), and evaluated at most once per point.
+template<class T>
+class PoissonStructureEvaluator
+{
+    PoissonStructure& d_poisson;
+    std::vector<T> d_point;
+    std::unordered_map<BivectorDerivativeKey, CompiledExpression<T>, BivectorDerivativeKeyHash> d_compiled;
+    std::unordered_map<BivectorDerivativeKey, T, BivectorDerivativeKeyHash> d_values;
+
+    public:
+    PoissonStructureEvaluator(PoissonStructure& poisson, std::vector<T> const& point)
+    : d_poisson(poisson), d_point(point)
+    {}
+
+    PoissonStructure& poisson() { return d_poisson; }
+    std::vector<T> const& point() const { return d_point; }
+
+    void point(std::vector<T> const& point)
+    {
+        d_point = point;
+        d_values.clear();
+    }
+
+    // Throws std::invalid_argument if the derivative cannot be evaluated in T
+    T const& bivector_derivative(BivectorDerivativeKey const& key)
+    {
+        auto value = d_values.find(key);
+        if (value != d_values.end())
+            return value->second;
+        auto compiled = d_compiled.find(key);
+        if (compiled == d_compiled.end())
+            compiled = d_compiled.insert({ key, CompiledExpression<T>(d_poisson.bivector_derivative(key), d_poisson.coordinates) }).first;
+        return d_values.insert({ key, compiled->second(d_point) }).first->second;
+    }
+};
+
+// The values of the bivector components (and their derivatives) of a Poisson structure at a batch of points, as for PoissonStructureEvaluator
+template<class T>
+class PoissonStructureBatchEvaluator
+{
+    PoissonStructure& d_poisson;
+    std::vector< std::vector<T> > d_points;
+    std::unordered_map<BivectorDerivativeKey, CompiledExpression<T>, BivectorDerivativeKeyHash> d_compiled;
+    std::unordered_map<BivectorDerivativeKey, PointBatch<T>, BivectorDerivativeKeyHash> d_values;
+
+    public:
+    PoissonStructureBatchEvaluator(PoissonStructure& poisson, std::vector< std::vector<T> > const& points)
+    : d_poisson(poisson), d_points(points)
+    {}
+
+    PoissonStructure& poisson() { return d_poisson; }
+    std::vector< std::vector<T> > const& points() const { return d_points; }
+
+    // Throws std::invalid_argument if the derivative cannot be evaluated in T
+    PointBatch<T> const& bivector_derivative(BivectorDerivativeKey const& key)
+    {
+        auto value = d_values.find(key);
+        if (value != d_values.end())
+            return value->second;
+        auto compiled = d_compiled.find(key);
+        if (compiled == d_compiled.end())
+            compiled = d_compiled.insert({ key, CompiledExpression<T>(d_poisson.bivector_derivative(key), d_poisson.coordinates) }).first;
+        std::vector<T> values;
+        for (auto& point : d_points)
+            values.push_back(compiled->second(point));
+        return d_values.insert({ key, PointBatch<T>(values) }).first->second;
+    }
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef INCLUDED_SOBOL_SEQUENCE_H_
+#define INCLUDED_SOBOL_SEQUENCE_H_
+
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+// Sobol low-discrepancy sequence in the unit cube (32 bits per coordinate), with the direction numbers of Joe and Kuo
+// (new-joe-kuo-6.21201), optionally randomized by a digital shift (xor with a fixed word per coordinate)
+class SobolSequence
+{
+    struct Parameters
+    {
+        unsigned degree;       // of the primitive polynomial
+        unsigned coefficients; // of the primitive polynomial, without the leading and constant ones
+        unsigned initial[7];   // the initial direction numbers m_1, ..., m_degree
+    };
+
+    size_t d_dimension;
+    std::vector<uint32_t> d_directions; // direction number v_bit of coordinate c in [c * 32 + bit]
+
+    static Parameters const* parameters()
+    {
+        static const Parameters table[] = {
+            { 1, 0, { 1 } },
+            { 2, 1, { 1, 3 } },
+            { 3, 1, { 1, 3, 1 } },
+            { 3, 2, { 1, 1, 1 } },
+            { 4, 1, { 1, 1, 3, 3 } },
+            { 4, 4, { 1, 3, 5, 13 } },
+            { 5, 2, { 1, 1, 5, 5, 17 } },
+            { 5, 4, { 1, 1, 5, 5, 5 } },
+            { 5, 7, { 1, 1, 7, 11, 19 } },
+            { 5, 11, { 1, 1, 5, 1, 1 } },
+            { 5, 13, { 1, 1, 1, 3, 11 } },
+            { 5, 14, { 1, 3, 5, 5, 31 } },
+            { 6, 1, { 1, 3, 3, 9, 7, 49 } },
+            { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+            { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+            { 6, 19, { 1, 1, 1, 15, 7, 5 } },
+            { 6, 22, { 1, 3, 1, 15, 13, 25 } },
+            { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+            { 7, 1, { 1, 3, 7, 11, 23, 15, 103 } },
+            { 7, 4, { 1, 3, 7, 13, 13, 15, 69 } }
+        };
+        return table;
+    }
+
+    public:
+    static const size_t max_dimension = 21;
+
+    // Throws std::invalid_argument if the dimension exceeds max_dimension
+    explicit SobolSequence(size_t dimension)
+    : d_dimension(dimension), d_directions(32 * dimension)
+    {
+        if (dimension > max_dimension)
+            throw std::invalid_argument("SobolSequence: dimension too large");
+        for (size_t bit = 0; bit != 32 && dimension != 0; ++bit)
+            d_directions[bit] = uint32_t(1) << (31 - bit); // van der Corput in the first coordinate
+        for (size_t c = 1; c < dimension; ++c)
+        {
+            Parameters const& p = parameters()[c - 1];
+            uint32_t* v = &d_directions[c * 32];
+            for (size_t bit = 0; bit != 32; ++bit)
+            {
+                if (bit < p.degree)
+                {
+                    v[bit] = uint32_t(p.initial[bit]) << (31 - bit);
+                    continue;
+                }
+                v[bit] = v[bit - p.degree] ^ (v[bit - p.degree] >> p.degree);
+                for (size_t k = 1; k < p.degree; ++k)
+                    if ((p.coefficients >> (p.degree - 1 - k)) & 1)
+                        v[bit] ^= v[bit - k];
+            }
+        }
+    }
+
+    size_t dimension() const { return d_dimension; }
+
+    // Writes the points with indices first, ..., first + count - 1 (in Gray code order; first + count <= 2^32), xored with the shift
+    // (one word per coordinate, or none), to points: dimension() coordinates in (0, 1) each
+    template<class T>
+    void generate(uint64_t first, size_t count, uint32_t const* shift, T* points) const
+    {
+        std::vector<uint32_t> x(d_dimension);
+        uint64_t gray = first ^ (first >> 1);
+        for (size_t bit = 0; bit != 32; ++bit)
+            if ((gray >> bit) & 1)
+                for (size_t c = 0; c != d_dimension; ++c)
+                    x[c] ^= d_directions[c * 32 + bit];
+        for (size_t k = 0; k != count; ++k)
+        {
+            if (k != 0)
+            {
+                size_t bit = 0; // the lowest zero bit of the previous index
+                for (uint64_t previous = first + k - 1; previous & 1; previous >>= 1)
+                    ++bit;
+                for (size_t c = 0; c != d_dimension; ++c)
+                    x[c] ^= d_directions[c * 32 + bit];
+            }
+            for (size_t c = 0; c != d_dimension; ++c)
+                points[k * d_dimension + c] = (T((shift ? x[c] ^ shift[c] : x[c])) + T(0.5)) / T(4294967296.0);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef INCLUDED_SPARSE_POLYNOMIAL_H_
+#define INCLUDED_SPARSE_POLYNOMIAL_H_
+
+#include "poisson_structure.hpp"
+#include "poisson_structure_evaluator.hpp" // for NumericTraits
+#include <ginac/ginac.h>
+#include <cln/cln.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+// Exponent vectors of monomials in up to 32 variables, packed into a 64-bit word: a field of 64/n bits per variable,
+// the first variable in the most significant field (so that the order of the words is the lexicographic order of the exponents).
+// The top bit of each field is kept free, to detect overflow when multiplying.
+class MonomialPacking
+{
+    size_t d_variables = 0, d_bits = 0;
+    uint64_t d_mask = 0; // of a field
+    uint64_t d_overflow = 0; // the top bits of the fields
+
+    public:
+    MonomialPacking() {}
+
+    // Throws std::length_error if there are more than 32 variables
+    explicit MonomialPacking(size_t variables)
+    : d_variables(variables), d_bits(variables == 0 ? 0 : 64 / variables)
+    {
+        if (variables > 32)
+            throw std::length_error("MonomialPacking: too many variables");
+        d_mask = (d_bits == 64) ? ~uint64_t(0) : (uint64_t(1) << d_bits) - 1;
+        for (size_t var = 0; var != variables; ++var)
+            d_overflow |= uint64_t(1) << (shift(var) + d_bits - 1);
+    }
+
+    size_t variables() const { return d_variables; }
+    size_t shift(size_t var) const { return (d_variables - 1 - var) * d_bits; }
+    uint64_t max_exponent() const { return (uint64_t(1) << (d_bits - 1)) - 1; }
+    uint64_t unit(size_t var) const { return uint64_t(1) << shift(var); }
+    uint64_t exponent(uint64_t monomial, size_t var) const { return (monomial >> shift(var)) & d_mask; }
+
+    // Throws std::overflow_error if an exponent becomes too large
+    uint64_t multiply(uint64_t first, uint64_t second) const
+    {
+        uint64_t product = first + second;
+        if (product & d_overflow)
+            throw std::overflow_error("MonomialPacking: exponent too large");
+        return product;
+    }
+
+    bool operator==(MonomialPacking const& other) const { return d_variables == other.d_variables; }
+};
+
+// Sparse multivariate polynomial with coefficients in C (e.g. cln::cl_RA): the nonzero terms, sorted by packed exponent vector.
+// A polynomial constructed from a number has no variables, and takes those of the other operand in arithmetic.
+template<class C>
+class SparsePolynomial
+{
+    public:
+    typedef std::pair<uint64_t, C> Term;
+
+    private:
+    MonomialPacking d_packing;
+    std::vector<Term> d_terms;
+
+    // Sorts terms, adds those with the same monomial, and removes zeros
+    void normalize()
+    {
+        std::sort(d_terms.begin(), d_terms.end(), [](Term const& a, Term const& b) { return a.first < b.first; });
+        size_t kept = 0;
+        for (size_t idx = 0; idx != d_terms.size(); )
+        {
+            uint64_t monomial = d_terms[idx].first;
+            C coefficient = d_terms[idx].second;
+            for (++idx; idx != d_terms.size() && d_terms[idx].first == monomial; ++idx)
+                coefficient = coefficient + d_terms[idx].second;
+            if (!NumericTraits<C>::is_zero(coefficient))
+                d_terms[kept++] = { monomial, coefficient };
+        }
+        d_terms.resize(kept);
+    }
+
+    void adopt_packing(SparsePolynomial const& other)
+    {
+        if (d_packing.variables() == 0)
+            d_packing = other.d_packing;
+        else if (other.d_packing.variables() != 0 && !(d_packing == other.d_packing))
+            throw std::invalid_argument("SparsePolynomial: different variables");
+    }
+
+    public:
+    SparsePolynomial(int value = 0)
+    {
+        if (value != 0)
+            d_terms.push_back({ 0, C(value) });
+    }
+
+    SparsePolynomial(MonomialPacking const& packing, std::vector<Term> const& terms)
+    : d_packing(packing), d_terms(terms)
+    {
+        normalize();
+    }
+
+    // The expanded expression as a polynomial in the variables; throws std::invalid_argument if it is not one with rational coefficients
+    static SparsePolynomial from_ex(GiNaC::ex const& expression, std::vector<GiNaC::symbol> const& variables)
+    {
+        using namespace GiNaC;
+        MonomialPacking packing(variables.size());
+        std::vector<Term> terms;
+        auto add_term = [&](ex const& term) {
+            uint64_t monomial = 0;
+            C coefficient = 1;
+            auto add_factor = [&](ex const& factor) {
+                ex base = factor, exponent = 1;
+                if (is_a<power>(factor))
+                {
+                    base = factor.op(0);
+                    exponent = factor.op(1);
+                }
+                if (is_a<numeric>(factor))
+                {
+                    coefficient = coefficient * NumericTraits<C>::from_numeric(ex_to<numeric>(factor));
+                    return;
+                }
+                size_t var = std::find_if(variables.begin(), variables.end(), [&base](symbol const& variable) { return base.is_equal(variable); }) - variables.begin();
+                if (var == variables.size() || !is_a<numeric>(exponent) || !ex_to<numeric>(exponent).is_pos_integer()
+                    || ex_to<numeric>(exponent).to_long() > (long)packing.max_exponent())
+                    throw std::invalid_argument("SparsePolynomial: not a polynomial in the variables");
+                monomial = packing.multiply(monomial, ex_to<numeric>(exponent).to_long() * packing.unit(var));
+            };
+            if (is_a<mul>(term))
+                for (ex const& factor : term)
+                    add_factor(factor);
+            else
+                add_factor(term);
+            terms.push_back({ monomial, coefficient });
+        };
+        ex expanded = expression.expand();
+        if (is_a<add>(expanded))
+            for (ex const& term : expanded)
+                add_term(term);
+        else if (!expanded.is_zero())
+            add_term(expanded);
+        return SparsePolynomial(packing, terms);
+    }
+
+    MonomialPacking const& packing() const { return d_packing; }
+    std::vector<Term> const& terms() const { return d_terms; }
+    bool is_zero() const { return d_terms.empty(); }
+
+    // The total degree (0 for the zero polynomial)
+    size_t degree() const
+    {
+        size_t result = 0;
+        for (Term const& term : d_terms)
+        {
+            size_t term_degree = 0;
+            for (size_t var = 0; var != d_packing.variables(); ++var)
+                term_degree += d_packing.exponent(term.first, var);
+            result = std::max(result, term_degree);
+        }
+        return result;
+    }
+
+    SparsePolynomial& operator+=(SparsePolynomial const& other)
+    {
+        adopt_packing(other);
+        std::vector<Term> sum;
+        sum.reserve(d_terms.size() + other.d_terms.size());
+        auto first = d_terms.begin(), second = other.d_terms.begin();
+        while (first != d_terms.end() || second != other.d_terms.end())
+        {
+            if (second == other.d_terms.end() || (first != d_terms.end() && first->first < second->first))
+                sum.push_back(*first++);
+            else if (first == d_terms.end() || second->first < first->first)
+                sum.push_back(*second++);
+            else
+            {
+                C coefficient = first->second + second->second;
+                if (!NumericTraits<C>::is_zero(coefficient))
+                    sum.push_back({ first->first, coefficient });
+                ++first;
+                ++second;
+            }
+        }
+        d_terms.swap(sum);
+        return *this;
+    }
+
+    // Throws std::overflow_error if an exponent becomes too large
+    SparsePolynomial& operator*=(SparsePolynomial const& other)
+    {
+        adopt_packing(other);
+        std::vector<Term> product;
+        product.reserve(d_terms.size() * other.d_terms.size());
+        for (Term const& a : d_terms)
+            for (Term const& b : other.d_terms)
+                product.push_back({ d_packing.multiply(a.first, b.first), a.second * b.second });
+        d_terms.swap(product);
+        normalize();
+        return *this;
+    }
+
+    SparsePolynomial operator-() const
+    {
+        SparsePolynomial result(*this);
+        for (Term& term : result.d_terms)
+            term.second = -term.second;
+        return result;
+    }
+
+    // The partial derivative by the variable with index var
+    SparsePolynomial diff(size_t var) const
+    {
+        SparsePolynomial result;
+        result.d_packing = d_packing;
+        for (Term const& term : d_terms)
+        {
+            uint64_t exponent = d_packing.exponent(term.first, var);
+            if (exponent != 0)
+                result.d_terms.push_back({ term.first - d_packing.unit(var), term.second * C((int)exponent) });
+        }
+        return result; // still sorted: the monomials with a positive exponent keep their order
+    }
+};
+
+template<class C>
+struct NumericTraits< SparsePolynomial<C> >
+{
+    static bool is_zero(SparsePolynomial<C> const& value) { return value.is_zero(); }
+};
+
+// The bivector components of a Poisson structure with polynomial entries, and their derivatives (computed on first use), as sparse
+// polynomials with rational coefficients in the coordinates followed by the other symbols (parameters) in the entries
+class PolynomialPoissonStructure
+{
+    PoissonStructure& d_poisson;
+    std::vector<GiNaC::symbol> d_variables;
+    std::unordered_map<BivectorDerivativeKey, SparsePolynomial<cln::cl_RA>, BivectorDerivativeKeyHash> d_derivatives;
+
+    public:
+    // Throws std::invalid_argument if an entry is not a polynomial with rational coefficients (or std::length_error if there are too many symbols)
+    PolynomialPoissonStructure(PoissonStructure& poisson)
+    : d_poisson(poisson), d_variables(poisson.coordinates)
+    {
+        for (auto& row : poisson.bivector)
+            for (GiNaC::ex const& entry : row)
+                for (auto it = entry.preorder_begin(); it != entry.preorder_end(); ++it)
+                    if (GiNaC::is_a<GiNaC::symbol>(*it) && std::find_if(d_variables.begin(), d_variables.end(),
+                                                                          [&it](GiNaC::symbol const& variable) { return (*it).is_equal(variable); }) == d_variables.end())
+                        d_variables.push_back(GiNaC::ex_to<GiNaC::symbol>(*it));
+        for (size_t i = 0; i != poisson.coordinates.size(); ++i)
+            for (size_t j = 0; j != poisson.coordinates.size(); ++j)
+                d_derivatives[BivectorDerivativeKey(i, j)] = SparsePolynomial<cln::cl_RA>::from_ex(poisson.bivector[i][j], d_variables);
+    }
+
+    PoissonStructure& poisson() { return d_poisson; }
+    std::vector<GiNaC::symbol> const& variables() const { return d_variables; } // the coordinates first
+
+    SparsePolynomial<cln::cl_RA> const& bivector_derivative(BivectorDerivativeKey const& key)
+    {
+        auto cached = d_derivatives.find(key);
+        if (cached != d_derivatives.end())
+            return cached->second;
+        SparsePolynomial<cln::cl_RA> derivative = bivector_derivative(key.without_last()).diff(key.derivative(key.derivatives() - 1));
+        return d_derivatives.insert({ key, derivative }).first->second;
+    }
+};
+
+#endif
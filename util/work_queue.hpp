@@ -0,0 +1,297 @@
+#ifndef INCLUDED_WORK_QUEUE_H_
+#define INCLUDED_WORK_QUEUE_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <csignal>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Work queue of named tasks in a directory, which may be on a filesystem shared by several machines.
+// A task is claimed by creating <name>.claim exclusively, with the host name and process id of the claimant in it; its result is written to
+// <name>.tmp and renamed to <name>.result when complete. A claim whose process is known to have died (on this host) is stale, and can be
+// taken over (see reclaim); a task claimed on another host whose worker died stays claimed: remove its .claim file to have it done again.
+// The computation the directory belongs to is recorded in its file MANIFEST (see bind).
+class DirectoryWorkQueue
+{
+    std::string d_directory;
+
+    std::string path(std::string const& task, std::string const& extension) const { return d_directory + "/" + task + extension; }
+
+    static std::string host_name()
+    {
+        char name[256] = "";
+        gethostname(name, sizeof(name) - 1);
+        return name;
+    }
+
+    static std::string read_file(std::string const& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+
+    // Whether a claim (the contents of a .claim file) was made by a process on this host that no longer exists
+    static bool abandoned(std::string const& claimant)
+    {
+        std::istringstream fields(claimant);
+        std::string host;
+        long pid;
+        if (!(fields >> host >> pid) || host != host_name())
+            return false;
+        return kill(pid, 0) == -1 && errno == ESRCH;
+    }
+
+    public:
+    // Creates the directory if necessary; throws std::runtime_error if that fails
+    DirectoryWorkQueue(std::string const& directory)
+    : d_directory(directory)
+    {
+        if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+            throw std::runtime_error("DirectoryWorkQueue: cannot create " + directory);
+    }
+
+    std::string const& directory() const { return d_directory; }
+
+    // Records the manifest (a description of the computation, e.g. the program and a fingerprint of its input) in the directory if it has none,
+    // and otherwise checks that it is the same; throws std::runtime_error if the directory belongs to a different computation
+    void bind(std::string const& manifest)
+    {
+        std::string manifest_path = d_directory + "/MANIFEST";
+        std::string temporary = manifest_path + ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            file << manifest;
+            if (!file)
+                throw std::runtime_error("DirectoryWorkQueue: cannot write " + temporary);
+        }
+        bool created = link(temporary.c_str(), manifest_path.c_str()) == 0; // atomically, also if other processes do the same
+        std::remove(temporary.c_str());
+        if (created)
+            return;
+        std::ifstream file(manifest_path, std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        if (!file || contents.str() != manifest)
+            throw std::runtime_error("DirectoryWorkQueue: " + d_directory + " belongs to a different computation (see its MANIFEST)");
+    }
+
+    // Returns true if the task was not claimed before (by any process)
+    bool claim(std::string const& task)
+    {
+        int fd = open(path(task, ".claim").c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666);
+        if (fd == -1)
+            return false;
+        std::string claimant = host_name() + " " + std::to_string(getpid()) + "\n";
+        bool written = write(fd, claimant.data(), claimant.size()) == (ssize_t)claimant.size();
+        close(fd);
+        (void)written; // an empty claim is still a claim, only not recognized as stale
+        return true;
+    }
+
+    // The host name and process id of the claimant of the task, or an empty string if it is not claimed
+    std::string claimant(std::string const& task) const
+    {
+        return read_file(path(task, ".claim"));
+    }
+
+    // Whether the task is not completed, and its claim was released or made by a process (on this host) that died
+    bool stale(std::string const& task) const
+    {
+        if (completed(task))
+            return false;
+        std::string claim_path = path(task, ".claim");
+        struct stat info;
+        if (stat(claim_path.c_str(), &info) != 0)
+            return true; // released
+        return abandoned(read_file(claim_path));
+    }
+
+    // Claims a task whose claim is stale; returns false if it is not stale, or another process took it over first
+    bool reclaim(std::string const& task)
+    {
+        if (!stale(task))
+            return false;
+        std::string claim_path = path(task, ".claim");
+        std::string moved = claim_path + ".stale." + host_name() + "." + std::to_string(getpid());
+        if (std::rename(claim_path.c_str(), moved.c_str()) == 0) // only one process can move a given claim away
+        {
+            if (!abandoned(read_file(moved))) // another process took the task over meanwhile: give its claim back
+            {
+                bool given_back = link(moved.c_str(), claim_path.c_str()) == 0; // fails only if the task was claimed again already
+                (void)given_back;
+                std::remove(moved.c_str());
+                return false;
+            }
+            std::remove(moved.c_str());
+        }
+        return claim(task);
+    }
+
+    // Gives up a claim (e.g. when the work failed), so that the task can be claimed again
+    void release(std::string const& task)
+    {
+        std::remove(path(task, ".tmp").c_str());
+        std::remove(path(task, ".claim").c_str());
+    }
+
+    // Throws std::runtime_error if the result cannot be written
+    void complete(std::string const& task, std::string const& result)
+    {
+        std::string temporary = path(task, ".tmp");
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            file << result;
+            if (!file)
+                throw std::runtime_error("DirectoryWorkQueue: cannot write " + temporary);
+        }
+        if (std::rename(temporary.c_str(), path(task, ".result").c_str()) != 0)
+            throw std::runtime_error("DirectoryWorkQueue: cannot rename " + temporary);
+    }
+
+    // Writes a file <task>.<name> that goes with the result (e.g. state for the parent to merge), before the task is completed;
+    // throws std::runtime_error if it cannot be written
+    void attach(std::string const& task, std::string const& name, std::string const& contents)
+    {
+        std::string temporary = path(task, "." + name + ".tmp");
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            file << contents;
+            if (!file)
+                throw std::runtime_error("DirectoryWorkQueue: cannot write " + temporary);
+        }
+        if (std::rename(temporary.c_str(), path(task, "." + name).c_str()) != 0)
+            throw std::runtime_error("DirectoryWorkQueue: cannot rename " + temporary);
+    }
+
+    // The contents of the file attached to the task under the name, or an empty string if there is none
+    std::string attachment(std::string const& task, std::string const& name) const
+    {
+        return read_file(path(task, "." + name));
+    }
+
+    bool completed(std::string const& task) const
+    {
+        struct stat info;
+        return stat(path(task, ".result").c_str(), &info) == 0;
+    }
+
+    std::string result(std::string const& task) const
+    {
+        return read_file(path(task, ".result"));
+    }
+
+    // Waits (polling) until the task is completed, e.g. by another machine, reporting on stderr every report_seconds which task
+    // it waits for and who claimed it. Throws std::runtime_error if the task becomes stale (see stale).
+    void wait(std::string const& task, unsigned poll_seconds = 1, unsigned report_seconds = 60) const
+    {
+        for (unsigned waited = 0; !completed(task); waited += poll_seconds)
+        {
+            if (stale(task))
+                throw std::runtime_error("DirectoryWorkQueue: task " + task + " in " + d_directory + " was abandoned by its worker");
+            if (waited != 0 && report_seconds != 0 && waited % report_seconds < poll_seconds)
+            {
+                std::string claimant = this->claimant(task);
+                if (!claimant.empty() && claimant.back() == '\n')
+                    claimant.pop_back();
+                fprintf(stderr, "Waiting for task %s in %s (claimed by %s) for %u s.\n", task.c_str(), d_directory.c_str(), claimant.c_str(), waited);
+            }
+            sleep(poll_seconds);
+        }
+    }
+
+    // Removes the files of the task, including those attached under the given names
+    void remove(std::string const& task, std::vector<std::string> const& attachments = {})
+    {
+        for (std::string const& name : attachments)
+            std::remove(path(task, "." + name).c_str());
+        std::remove(path(task, ".result").c_str());
+        release(task);
+    }
+};
+
+// Size and (64-bit FNV-1a) hash of the contents of a file, e.g. for a manifest; empty if it cannot be read
+inline std::string file_fingerprint(std::string const& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return "";
+    uint64_t hash = 14695981039346656037ULL, size = 0;
+    char buffer[65536];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() != 0)
+    {
+        for (std::streamsize idx = 0; idx != file.gcount(); ++idx)
+            hash = (hash ^ (unsigned char)buffer[idx]) * 1099511628211ULL;
+        size += file.gcount();
+    }
+    std::ostringstream fingerprint;
+    fingerprint << size << " bytes, hash " << std::hex << hash;
+    return fingerprint.str();
+}
+
+// Runs work() in each of the given number of forked child processes (in the parent if processes is 1), and waits for them.
+// An exception in a child is reported on stderr. Returns false if some child (or the work in the parent) failed.
+inline bool fork_workers(size_t processes, std::function<void()> const& work)
+{
+    if (processes <= 1)
+    {
+        try {
+            work();
+        }
+        catch (std::exception const& e)
+        {
+            fprintf(stderr, "%s\n", e.what());
+            return false;
+        }
+        return true;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    bool success = true;
+    size_t children = 0;
+    for (size_t p = 0; p != processes; ++p)
+    {
+        pid_t pid = fork();
+        if (pid == -1)
+        {
+            success = false;
+            break;
+        }
+        if (pid == 0)
+        {
+            int status = 0;
+            try {
+                work();
+            }
+            catch (std::exception const& e)
+            {
+                fprintf(stderr, "%s\n", e.what());
+                status = 1;
+            }
+            fflush(stderr);
+            _exit(status); // without destructors and exit handlers of the parent's state
+        }
+        ++children;
+    }
+    for (; children != 0; --children)
+    {
+        int status;
+        if (wait(&status) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            success = false;
+    }
+    return success;
+}
+
+#endif